@@ -0,0 +1,104 @@
+#ifndef MIPS_AS_H
+#define MIPS_AS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Embedding API: assembles sources held in memory and reports errors as
+// diagnostics instead of exiting. A context assembles one source at a time
+// on the calling thread and keeps its buffers for the next one, so reusing
+// a context avoids most allocations. Use one context per thread.
+
+typedef struct mips_as_context mips_as_context_t;
+
+typedef struct mips_as_options {
+    // sections start at 0 and references to symbols become relocations
+    bool relocatable;
+    bool big_endian;
+    // fill branch delay slots with the instruction before the branch
+    bool optimize;
+} mips_as_options_t;
+
+typedef enum mips_as_section_id {
+    MIPS_AS_TEXT,
+    MIPS_AS_DATA,
+    // target of relocations against absolute addresses
+    MIPS_AS_ABSOLUTE,
+} mips_as_section_id_t;
+
+typedef enum mips_as_reloc_kind {
+    MIPS_AS_HI16,       // upper half of an absolute address (lui)
+    MIPS_AS_LO16,       // lower half of an absolute address (addiu)
+    MIPS_AS_PC16,       // branch offset relative to the delay slot
+    MIPS_AS_J26,        // jump target within the current 256MB region
+    MIPS_AS_WORD32,     // full 32 bit address (.word)
+} mips_as_reloc_kind_t;
+
+typedef struct mips_as_section {
+    const uint8_t* data;
+    uint32_t size;
+    uint32_t address;
+    uint32_t align;
+} mips_as_section_t;
+
+typedef struct mips_as_symbol {
+    const char* name;
+    mips_as_section_id_t section;
+    // section offset for relocatable output
+    uint32_t address;
+    bool defined;
+    bool global;
+} mips_as_symbol_t;
+
+typedef struct mips_as_relocation {
+    mips_as_reloc_kind_t kind;
+    mips_as_section_id_t section;
+    uint32_t offset;
+    // NULL for a reference to the start of section `target`
+    const char* symbol;
+    mips_as_section_id_t target;
+    uint32_t line;
+} mips_as_relocation_t;
+
+typedef struct mips_as_diagnostic {
+    // 1-based, 0 where not known
+    uint32_t line;
+    uint32_t column;
+    // bytes of the source the error is about, length 0 where not known
+    uint32_t offset;
+    uint32_t length;
+    // the text the command line prints, with a trailing newline
+    const char* message;
+} mips_as_diagnostic_t;
+
+// Everything points into the context and stays valid until its next use
+typedef struct mips_as_result {
+    mips_as_section_t text;
+    mips_as_section_t data;
+    // sorted by name
+    const mips_as_symbol_t* symbols;
+    uint32_t nsymbols;
+    // in the order of an ELF object, each HI16 right before its LO16
+    const mips_as_relocation_t* relocations;
+    uint32_t nrelocations;
+    // the first errors of the source, up to a limit, in source order
+    const mips_as_diagnostic_t* diagnostics;
+    uint32_t ndiagnostics;
+    // errors found past that limit
+    uint32_t ndropped;
+    // branch delay slots emitted, and those filled by `optimize`
+    uint32_t delay_slots;
+    uint32_t delay_filled;
+} mips_as_result_t;
+
+mips_as_context_t* mips_as_context_new(void);
+void mips_as_context_free(mips_as_context_t* ctx);
+
+// Assembles `len` bytes of `src`, with the default options if `options` is
+// NULL. Returns false if the source has errors; `result` then only holds the
+// diagnostics. Assembly goes on past an error, so one call reports them all.
+bool mips_as_assemble(mips_as_context_t* ctx, const char* src, size_t len, const mips_as_options_t* options,
+                      mips_as_result_t* result);
+
+#endif //MIPS_AS_H
@@ -8,9 +8,21 @@
 
 #include <glib.h>
 
+// Receives an error found at `line`:`column` of the source, 0 where not
+// known. `message` is the text printed when there is no handler, it is only
+// valid during the call.
+typedef void (*fatal_handler_t)(uint32_t line, uint32_t column, const char* message, gpointer data);
+
+// Reports an error and exits, unless a handler was set on the calling
+// thread that longjmps out; if the handler returns, fatal exits as if there
+// was none.
+G_GNUC_NORETURN void fatal(uint32_t line, uint32_t column, const char* format, ...) G_GNUC_PRINTF(3, 4);
+void fatal_set_handler(fatal_handler_t handler, gpointer data);
+// The handler of the calling thread, to restore after setting another one
+void fatal_get_handler(fatal_handler_t* handler, gpointer* data);
+
 #define FATAL(...) {                \
-    g_printerr(__VA_ARGS__);        \
-    exit(-1);                       \
+    fatal(0, 0, __VA_ARGS__);       \
 }
 
 #endif //ASM_PRELUDE_H
@@ -0,0 +1,60 @@
+#include "arena.h"
+
+#include <string.h>
+
+#define ARENA_ALIGN(x) (((x) + 7) & ~(size_t) 7)
+
+static arena_chunk_t* arena_chunk_new(arena_t* arena, size_t capacity, arena_chunk_t* next) {
+    arena->allocations++;
+    arena_chunk_t* chunk = g_malloc(sizeof(arena_chunk_t) + capacity);
+    chunk->next = next;
+    chunk->capacity = capacity;
+    chunk->used = 0;
+    return chunk;
+}
+
+void arena_init(arena_t* arena) {
+    arena->allocations = 0;
+    arena->chunks = arena_chunk_new(arena, ARENA_CHUNK_SIZE, NULL);
+}
+
+void arena_free(arena_t* arena) {
+    arena_chunk_t* chunk = arena->chunks;
+    while (chunk != NULL) {
+        arena_chunk_t* next = chunk->next;
+        g_free(chunk);
+        chunk = next;
+    }
+    arena->chunks = NULL;
+}
+
+void arena_reset(arena_t* arena) {
+    // chunks are linked newest first, the first one allocated is the last
+    arena_chunk_t* chunk = arena->chunks;
+    while (chunk->next != NULL) {
+        arena_chunk_t* next = chunk->next;
+        g_free(chunk);
+        chunk = next;
+    }
+    chunk->used = 0;
+    arena->chunks = chunk;
+}
+
+void* arena_alloc(arena_t* arena, size_t size) {
+    size = ARENA_ALIGN(size);
+    arena_chunk_t* chunk = arena->chunks;
+    if (G_UNLIKELY(chunk->capacity - chunk->used < size)) {
+        chunk = arena_chunk_new(arena, MAX(size, ARENA_CHUNK_SIZE), chunk);
+        arena->chunks = chunk;
+    }
+    void* ptr = chunk->data + chunk->used;
+    chunk->used += size;
+    return ptr;
+}
+
+char* arena_strndup(arena_t* arena, const char* str, size_t len) {
+    char* copy = arena_alloc(arena, len + 1);
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    return copy;
+}
@@ -0,0 +1,34 @@
+#ifndef ASM_ARENA_H
+#define ASM_ARENA_H
+
+#include <mips-as/prelude.h>
+
+#define ARENA_CHUNK_SIZE 4096
+
+typedef struct arena_chunk {
+    struct arena_chunk* next;
+    size_t capacity;
+    size_t used;
+    uint8_t data[];
+} arena_chunk_t;
+
+// Bump allocator. Allocations are never freed individually, everything is
+// released at once by arena_reset or arena_free.
+typedef struct arena {
+    arena_chunk_t* chunks;
+    // chunks allocated so far, for --stats
+    uint64_t allocations;
+} arena_t;
+
+void arena_init(arena_t* arena);
+void arena_free(arena_t* arena);
+
+// Releases every allocation but keeps the first chunk for reuse
+void arena_reset(arena_t* arena);
+
+void* arena_alloc(arena_t* arena, size_t size);
+char* arena_strndup(arena_t* arena, const char* str, size_t len);
+
+#define arena_new(arena, T, n) ((T*) arena_alloc(arena, sizeof(T) * (n)))
+
+#endif //ASM_ARENA_H
@@ -1,27 +1,1496 @@
 #include "assembler.h"
-#include "parse/token.h"
+#include "opcodes.h"
+#include "parse/parser.h"
+#include "parse/scan.h"
 
+#include <stdarg.h>
 #include <string.h>
-#include <ctype.h>
+
+static G_GNUC_NORETURN void as_error(uint32_t line, const char* format, ...) G_GNUC_PRINTF(2, 3);
+
+#define AS_REQUIRE(expr, line, ...) {                               \
+    if (!(expr)) {                                                  \
+        as_error((line), __VA_ARGS__);                              \
+    }                                                               \
+}
+
+typedef enum directive {
+    DIR_TEXT,
+    DIR_DATA,
+    DIR_GLOBL,
+    DIR_GLOBAL,
+    DIR_WORD,
+    DIR_HALF,
+    DIR_BYTE,
+    DIR_ASCII,
+    DIR_ASCIIZ,
+    DIR_SPACE,
+    DIR_ALIGN,
+    DIR_UNKNOWN,
+} directive_t;
+
+static const char* directive_names[DIR_UNKNOWN] = {
+    [DIR_TEXT] = "text",
+    [DIR_DATA] = "data",
+    [DIR_GLOBL] = "globl",
+    [DIR_GLOBAL] = "global",
+    [DIR_WORD] = "word",
+    [DIR_HALF] = "half",
+    [DIR_BYTE] = "byte",
+    [DIR_ASCII] = "ascii",
+    [DIR_ASCIIZ] = "asciiz",
+    [DIR_SPACE] = "space",
+    [DIR_ALIGN] = "align",
+};
+
+static atom_t directive_atoms[DIR_UNKNOWN];
+
+static void directives_init(void) {
+    static gsize once = 0;
+    if (g_once_init_enter(&once)) {
+        for (uint32_t i = 0; i < DIR_UNKNOWN; i++) {
+            directive_atoms[i] = intern(directive_names[i], strlen(directive_names[i]));
+        }
+        g_once_init_leave(&once, 1);
+    }
+}
+
+static directive_t directive_from_atom(atom_t atom) {
+    for (uint32_t i = 0; i < DIR_UNKNOWN; i++) {
+        if (directive_atoms[i] == atom) {
+            return (directive_t) i;
+        }
+    }
+    return DIR_UNKNOWN;
+}
+
+static void as_error(uint32_t line, const char* format, ...) {
+    char text[256];
+    va_list args;
+    va_start(args, format);
+    g_vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    fatal(line, 0, "Assembler Error: %s (line %d)\n", text, line);
+}
+
+// Records an error without leaving the current statement, or reports it like
+// as_error without diagnostics
+static G_GNUC_PRINTF(3, 4) void as_report(assembler_t* as, uint32_t line, const char* format, ...) {
+    char text[256];
+    va_list args;
+    va_start(args, format);
+    g_vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    diag_report(as->diags, line, 0, 0, 0, "Assembler Error: %s (line %d)\n", text, line);
+}
+
+// Installed while `as` runs with diagnostics
+static void as_recover(uint32_t line, uint32_t column, const char* message, gpointer data) {
+    assembler_t* as = data;
+    if (as->recovering) {
+        as->recovering = false;
+        diag_report(as->diags, line, column, 0, 0, "%s", message);
+        longjmp(as->recover, 1);
+    }
+    // not within a statement, the run cannot go on
+    if (as->outer_handler != NULL) {
+        as->outer_handler(line, column, message, as->outer_data);
+    } else {
+        GString* out = g_string_new(NULL);
+        diag_print(out, "", as->diags);
+        g_printerr("%s", out->str);
+        g_string_free(out, TRUE);
+    }
+}
+
+// Brackets the parts of a run that may recover from errors, runs nest when
+// assembler_run_parallel falls back to assembler_run
+static void recover_begin(assembler_t* as) {
+    if (as->diags != NULL && as->handler_depth++ == 0) {
+        fatal_get_handler(&as->outer_handler, &as->outer_data);
+        fatal_set_handler(as_recover, as);
+    }
+}
+
+static void recover_end(assembler_t* as) {
+    if (as->diags != NULL && --as->handler_depth == 0) {
+        fatal_set_handler(as->outer_handler, as->outer_data);
+    }
+}
 
 assembler_t assembler_new(const char* src, size_t len) {
     assembler_t assembler;
     assembler.textbuff = buffer_create();
+    assembler.textbuff.base = TEXT_BASE;
     assembler.databuff = buffer_create();
+    assembler.databuff.base = DATA_BASE;
+    assembler.inheritbuff = buffer_create();
     assembler.sector = SECTOR_TEXT;
+    symtab_init(&assembler.symbols);
+    assembler.deferred = false;
+    assembler.references = NULL;
+    assembler.inherit_text_line = 0;
+    assembler.relocatable = false;
+    assembler.relocations = g_array_new(FALSE, FALSE, sizeof(reference_t));
+    assembler.big_endian = false;
+    assembler.optimize = false;
+    assembler.slot = (slot_t) { SLOT_NONE, SECTOR_TEXT, 0, 0, 0 };
+    assembler.delay_slots = 0;
+    assembler.delay_filled = 0;
+    assembler.slot_unknown_used = false;
+    assembler.expr_unresolved = false;
+    assembler.stats = NULL;
+    assembler.diags = NULL;
+    assembler.recovering = false;
+    assembler.handler_depth = 0;
+    assembler.outer_handler = NULL;
+    assembler.outer_data = NULL;
+    assembler.parser = NULL;
+    assembler.block = NULL;
+    assembler.src = src;
+    assembler.len = len;
+    assembler.line = 1;
+    assembler.path = NULL;
+    directives_init();
     return assembler;
 }
 
+// Ends the run in progress, if any
+static void release_parser(assembler_t* as) {
+    if (as->parser != NULL) {
+        parser_free(as->parser);
+        g_free(as->parser);
+        as->parser = NULL;
+    }
+    if (as->block != NULL) {
+        ir_free(as->block);
+        g_free(as->block);
+        as->block = NULL;
+    }
+}
+
 void assembler_free(assembler_t* as) {
-    g_queue_free_full(as->tokens, token_free);
+    release_parser(as);
+    buffer_free(&as->textbuff);
+    buffer_free(&as->databuff);
+    buffer_free(&as->inheritbuff);
+    symtab_free(&as->symbols);
+    if (as->references != NULL) {
+        g_array_free(as->references, TRUE);
+    }
+    g_array_free(as->relocations, TRUE);
+}
+
+static void buffer_clear(buffer_t* buff) {
+    buff->size = 0;
+    buff->align = 1;
+}
+
+void assembler_reset(assembler_t* as, const char* src, size_t len) {
+    release_parser(as);
+    buffer_clear(&as->textbuff);
+    buffer_clear(&as->databuff);
+    buffer_clear(&as->inheritbuff);
+    as->sector = SECTOR_TEXT;
+    symtab_clear(&as->symbols);
+    if (as->references != NULL) {
+        g_array_set_size(as->references, 0);
+    }
+    as->inherit_text_line = 0;
+    g_array_set_size(as->relocations, 0);
+    as->slot = (slot_t) { SLOT_NONE, SECTOR_TEXT, 0, 0, 0 };
+    as->delay_slots = 0;
+    as->delay_filled = 0;
+    as->slot_unknown_used = false;
+    as->expr_unresolved = false;
+    as->recovering = false;
+    as->handler_depth = 0;
+    as->src = src;
+    as->len = len;
+    as->line = 1;
+}
+
+void assembler_set_relocatable(assembler_t* as, bool relocatable) {
+    as->relocatable = relocatable;
+    as->textbuff.base = relocatable ? 0 : TEXT_BASE;
+    as->databuff.base = relocatable ? 0 : DATA_BASE;
+}
+
+void assembler_set_big_endian(assembler_t* as, bool big_endian) {
+    as->big_endian = big_endian;
+    as->textbuff.big_endian = big_endian;
+    as->databuff.big_endian = big_endian;
+    as->inheritbuff.big_endian = big_endian;
+}
+
+void assembler_set_optimize(assembler_t* as, bool optimize) {
+    as->optimize = optimize;
+}
+
+void assembler_set_stats(assembler_t* as, stats_t* stats) {
+    as->stats = stats;
+}
+
+void assembler_set_path(assembler_t* as, const char* path) {
+    as->path = path;
+}
+
+void assembler_set_diagnostics(assembler_t* as, diagnostics_t* diags) {
+    as->diags = diags;
+}
+
+// Section buffer and symbol allocations, once the assembler is done
+static void count_allocations(const assembler_t* as) {
+    as->stats->phases[PHASE_ASSEMBLE].allocations += as->textbuff.allocations + as->databuff.allocations
+        + as->inheritbuff.allocations + g_hash_table_size(as->symbols.symbols);
+}
+
+static inline buffer_t* sector_buffer(assembler_t* as, uint32_t sector) {
+    switch (sector) {
+        case SECTOR_TEXT:
+            return &as->textbuff;
+        case SECTOR_DATA:
+            return &as->databuff;
+        default:
+            return &as->inheritbuff;
+    }
+}
+
+static inline buffer_t* current(assembler_t* as) {
+    return sector_buffer(as, as->sector);
+}
+
+static inline uint32_t address(buffer_t* buff) {
+    return buff->base + buff->size;
+}
+
+// The longest expansion of a single statement, in words
+#define MAX_STATEMENT_WORDS 4
+
+// Room for MAX_STATEMENT_WORDS must have been reserved
+static inline uint32_t emit_word(buffer_t* buff, uint32_t word) {
+    return buffer_emit_word(buff, word);
 }
 
-static inline token_t* peek(assembler_t* as) {
-    return g_queue_peek_head(as->tokens);
+static inline uint32_t encode_r(uint32_t rs, uint32_t rt, uint32_t rd, uint32_t sa, uint32_t funct) {
+    return (rs << 21) | (rt << 16) | (rd << 11) | ((sa & 0x1f) << 6) | (funct & 0x3f);
+}
+
+static inline uint32_t encode_i(uint32_t op, uint32_t rs, uint32_t rt, uint32_t imm) {
+    return (op << 26) | (rs << 21) | (rt << 16) | (imm & 0xffff);
+}
+
+static inline uint32_t encode_j(uint32_t op, uint32_t target) {
+    return (op << 26) | ((target >> 2) & 0x03ffffff);
+}
+
+// Operand accessors
+
+static inline argument_t* arg_at(const statement_t* stmt, guint i) {
+    return &stmt->instruction.arguments[i];
+}
+
+static uint32_t arg_reg(const statement_t* stmt, guint i) {
+    argument_t* arg = arg_at(stmt, i);
+    AS_REQUIRE(arg->type == ARG_REGISTER, stmt->line, "%s: operand %d must be a register",
+               atom_str(stmt->instruction.name), i + 1)
+    AS_REQUIRE(arg->reg < 32, stmt->line, "%s: invalid register $%d", atom_str(stmt->instruction.name), arg->reg)
+    return arg->reg;
+}
+
+// Fills the field selected by `kind` of an already emitted word with `value`
+static void patch(assembler_t* as, fixup_kind_t kind, uint32_t sector, uint32_t offset, uint32_t value,
+                  uint32_t line) {
+    buffer_t* buff = sector_buffer(as, sector);
+    uint32_t pc = buff->base + offset;
+    uint32_t word = buffer_word_at(buff, offset);
+
+    switch (kind) {
+        case FIXUP_HI16:
+            // the low half is added sign extended, carry into the high half
+            word = (word & 0xffff0000) | ((value + 0x8000) >> 16);
+            break;
+        case FIXUP_LO16:
+            word = (word & 0xffff0000) | (value & 0xffff);
+            break;
+        case FIXUP_PC16: {
+            int32_t diff = (int32_t) (value - (pc + 4));
+            AS_REQUIRE(diff % 4 == 0, line, "Branch target 0x%08x is not word aligned", value)
+            diff /= 4;
+            AS_REQUIRE(diff >= -32768 && diff <= 32767, line, "Branch target 0x%08x out of range", value)
+            word = (word & 0xffff0000) | ((uint32_t) diff & 0xffff);
+            break;
+        }
+        case FIXUP_J26:
+            AS_REQUIRE(value % 4 == 0 && (value & 0xf0000000) == ((pc + 4) & 0xf0000000), line,
+                       "Jump target 0x%08x out of range", value)
+            word = (word & 0xfc000000) | ((value >> 2) & 0x03ffffff);
+            break;
+        case FIXUP_WORD32:
+            word = value;
+            break;
+    }
+
+    buffer_set_word_at(buff, offset, word);
+}
+
+// Leaves the word for the linker to fill in with `symbol` (or the start of
+// section `target` if ATOM_NONE) plus `addend`. The addend goes in place, as
+// REL relocations have no field for it.
+static void add_relocation(assembler_t* as, fixup_kind_t kind, uint32_t sector, uint32_t offset, atom_t symbol,
+                           uint32_t target, uint32_t addend, uint32_t line) {
+    reference_t rel = { kind, sector, offset, line, symbol, target, addend, false };
+    g_array_append_val(as->relocations, rel);
+
+    buffer_t* buff = sector_buffer(as, sector);
+    uint32_t word = buffer_word_at(buff, offset);
+    switch (kind) {
+        case FIXUP_HI16:
+            word = (word & 0xffff0000) | ((addend + 0x8000) >> 16);
+            break;
+        case FIXUP_LO16:
+            word = (word & 0xffff0000) | (addend & 0xffff);
+            break;
+        case FIXUP_PC16: {
+            // relative to the branch, which the linker adds back
+            int32_t diff = (int32_t) (addend - 4);
+            AS_REQUIRE(diff >= -131072 && diff <= 131071, line, "Branch target 0x%08x out of range", addend)
+            word = (word & 0xffff0000) | (((addend - 4) >> 2) & 0xffff);
+            break;
+        }
+        case FIXUP_J26:
+            word = (word & 0xfc000000) | ((addend >> 2) & 0x03ffffff);
+            break;
+        case FIXUP_WORD32:
+            word = addend;
+            break;
+    }
+    buffer_set_word_at(buff, offset, word);
+}
+
+static void relocate(assembler_t* as, fixup_kind_t kind, uint32_t sector, uint32_t offset, const symbol_t* sym,
+                     uint32_t addend, uint32_t line) {
+    // branches within a section do not depend on where it is loaded
+    if (sym->defined && kind == FIXUP_PC16 && sym->sector == sector) {
+        patch(as, kind, sector, offset, sym->address + addend, line);
+    } else if (sym->defined && !sym->global) {
+        // local symbols are not exported, refer to their section instead
+        add_relocation(as, kind, sector, offset, ATOM_NONE, sym->sector, sym->address + addend, line);
+    } else {
+        add_relocation(as, kind, sector, offset, sym->name, 0, addend, line);
+    }
+}
+
+// Fills in a reference to a plain address
+static void resolve_value(assembler_t* as, fixup_kind_t kind, uint32_t sector, uint32_t offset, uint32_t value,
+                          uint32_t line) {
+    // where a branch lands relative to an absolute address is not known
+    // until the section is placed
+    if (as->relocatable && kind == FIXUP_PC16) {
+        add_relocation(as, kind, sector, offset, ATOM_NONE, SECTOR_ABSOLUTE, value, line);
+        return;
+    }
+    patch(as, kind, sector, offset, value, line);
+}
+
+// Resolves a reference to a symbol plus `addend`, now that the symbol is
+// defined or never will be
+static void resolve(assembler_t* as, fixup_kind_t kind, uint32_t sector, uint32_t offset, const symbol_t* sym,
+                    uint32_t addend, uint32_t line) {
+    if (as->relocatable) {
+        relocate(as, kind, sector, offset, sym, addend, line);
+        return;
+    }
+    AS_REQUIRE(sym->defined, line, "Undefined symbol: %s", atom_str(sym->name))
+    patch(as, kind, sector, offset, sym->address + addend, line);
+}
+
+// What an operand refers to: `num`, plus the address of `sym` unless that is
+// ATOM_NONE. `part` is EXPR_HI or EXPR_LO for that half of it, EXPR_NUMBER
+// for all of it.
+typedef struct target {
+    atom_t sym;
+    uint32_t num;
+    expr_opcode_t part;
+} target_t;
+
+// Emits a word that refers to `target`. Numbers and defined symbols are
+// patched in right away, forward references are chained on their symbol and
+// patched when the label is defined.
+static void emit_ref(assembler_t* as, uint32_t word, const target_t* target, fixup_kind_t kind, uint32_t line) {
+    buffer_t* buff = current(as);
+    uint32_t offset = emit_word(buff, word) - buff->base;
+
+    if (as->deferred) {
+        reference_t ref = { kind, as->sector, offset, line, target->sym, target->num, 0, false };
+        g_array_append_val(as->references, ref);
+        return;
+    }
+
+    if (target->sym == ATOM_NONE) {
+        resolve_value(as, kind, as->sector, offset, target->num, line);
+        return;
+    }
+
+    symbol_t* sym = symtab_get(&as->symbols, target->sym);
+    if (sym->defined) {
+        resolve(as, kind, as->sector, offset, sym, target->num, line);
+    } else {
+        fixup_t fixup = { kind, as->sector, offset, line, target->num, FIXUP_NONE };
+        symtab_add_fixup(&as->symbols, sym, fixup);
+    }
+}
+
+// Expressions
+
+// Whether `a` minus `b` is known: both are defined in the same section, whose
+// placement does not matter then
+static bool same_section(assembler_t* as, atom_t a, atom_t b, uint32_t* difference) {
+    const symbol_t* x = symtab_get(&as->symbols, a);
+    const symbol_t* y = symtab_get(&as->symbols, b);
+    *difference = x->address - y->address;
+    return x->defined && y->defined && x->sector == y->sector;
+}
+
+// Evaluates an expression as far as the symbols defined so far allow. Those
+// stand for their address if it is final, and what is left must be a symbol
+// plus a constant, which a fixup or a relocation can fill in later. A %hi or
+// %lo around everything applies to that as well. Returns false otherwise,
+// with the symbol in the way in `culprit`.
+static bool expr_eval(assembler_t* as, const expr_op_t* ops, uint32_t count, uint32_t line, target_t* out,
+                      atom_t* culprit) {
+    target_t stack[EXPR_MAX_OPS];
+    uint32_t depth = 0;
+    expr_opcode_t part = ops[count - 1].code;
+    if (part == EXPR_HI || part == EXPR_LO) {
+        count--;
+    } else {
+        part = EXPR_NUMBER;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        const expr_op_t* op = &ops[i];
+        if (op->code == EXPR_NUMBER) {
+            stack[depth++] = (target_t) { ATOM_NONE, op->num, EXPR_NUMBER };
+            continue;
+        }
+        if (op->code == EXPR_SYMBOL) {
+            const symbol_t* sym = symtab_get(&as->symbols, op->sym);
+            bool known = sym->defined && !as->relocatable && !as->deferred;
+            stack[depth++] = (target_t) { known ? ATOM_NONE : op->sym, known ? sym->address : 0, EXPR_NUMBER };
+            continue;
+        }
+
+        target_t* a = &stack[depth - 1];
+        if (expr_is_unary(op->code)) {
+            if (a->sym != ATOM_NONE) {
+                *culprit = a->sym;
+                return false;
+            }
+            expr_apply(op->code, a->num, 0, &a->num);
+            continue;
+        }
+
+        const target_t* b = &stack[--depth];
+        a = &stack[depth - 1];
+        uint32_t difference;
+        if (a->sym == ATOM_NONE && b->sym == ATOM_NONE) {
+            AS_REQUIRE(expr_apply(op->code, a->num, b->num, &a->num), line, "Division by zero")
+        } else if (op->code == EXPR_ADD && (a->sym == ATOM_NONE || b->sym == ATOM_NONE)) {
+            a->sym = a->sym != ATOM_NONE ? a->sym : b->sym;
+            a->num += b->num;
+        } else if (op->code == EXPR_SUB && b->sym == ATOM_NONE) {
+            a->num -= b->num;
+        } else if (op->code == EXPR_SUB && same_section(as, a->sym, b->sym, &difference)) {
+            a->sym = ATOM_NONE;
+            a->num = difference + a->num - b->num;
+        } else {
+            // rather one that is not defined yet, if any
+            bool later = b->sym != ATOM_NONE && !symtab_get(&as->symbols, b->sym)->defined;
+            *culprit = a->sym != ATOM_NONE && !later ? a->sym : b->sym;
+            return false;
+        }
+    }
+
+    *out = stack[0];
+    out->part = part;
+    return true;
+}
+
+// The target of an expression. In a chunk of a parallel run one that cannot
+// be evaluated may only need the addresses of earlier chunks: it stands for 0
+// and chunk_merge has the chunk assembled in order instead.
+static void expr_target(assembler_t* as, const statement_t* stmt, expr_ref_t expr, target_t* target) {
+    atom_t culprit;
+    if (expr_eval(as, stmt->exprs + expr.first, expr.count, stmt->line, target, &culprit)) {
+        return;
+    }
+    if (as->deferred) {
+        as->expr_unresolved = true;
+        *target = (target_t) { ATOM_NONE, 0, EXPR_NUMBER };
+        return;
+    }
+    AS_REQUIRE(symtab_get(&as->symbols, culprit)->defined, stmt->line, "Expression uses %s before it is defined",
+               atom_str(culprit))
+    as_error(stmt->line, "Expression on %s is not a symbol plus a constant", atom_str(culprit));
+}
+
+// The target of a number, symbol or expression operand, false for any other
+static bool arg_target(assembler_t* as, const statement_t* stmt, const argument_t* arg, target_t* target) {
+    switch (arg->type) {
+        case ARG_NUMBER:
+            *target = (target_t) { ATOM_NONE, arg->num, EXPR_NUMBER };
+            return true;
+        case ARG_SYMBOL:
+            *target = (target_t) { arg->sym, 0, EXPR_NUMBER };
+            return true;
+        case ARG_EXPR:
+            expr_target(as, stmt, arg->expr, target);
+            return true;
+        default:
+            return false;
+    }
+}
+
+// The address an operand refers to, for a fixup that takes all of it
+static void arg_address(assembler_t* as, const statement_t* stmt, const argument_t* arg, target_t* target) {
+    AS_REQUIRE(arg_target(as, stmt, arg, target), stmt->line, "Expected an address or a symbol")
+    if (target->sym == ATOM_NONE) {
+        expr_apply(target->part, target->num, 0, &target->num);
+        target->part = EXPR_NUMBER;
+    }
+    AS_REQUIRE(target->part == EXPR_NUMBER, stmt->line, "Expected an address or a symbol")
+}
+
+// A symbol where a constant is needed. A chunk may not know that it was
+// defined before, which chunk_merge finds out by assembling it in order.
+static bool expr_symbolic(assembler_t* as) {
+    if (as->deferred) {
+        as->expr_unresolved = true;
+    }
+    return !as->deferred;
+}
+
+// The value of a number operand, or of an expression that is constant by now
+static bool arg_constant(assembler_t* as, const statement_t* stmt, const argument_t* arg, uint32_t* value) {
+    if (arg->type == ARG_NUMBER) {
+        *value = arg->num;
+        return true;
+    }
+    target_t target;
+    if (arg->type != ARG_EXPR) {
+        return false;
+    }
+    expr_target(as, stmt, arg->expr, &target);
+    expr_apply(target.part, target.num, 0, value);
+    return target.sym == ATOM_NONE || !expr_symbolic(as);
+}
+
+static uint32_t arg_imm(assembler_t* as, const statement_t* stmt, guint i) {
+    uint32_t value;
+    AS_REQUIRE(arg_constant(as, stmt, arg_at(stmt, i), &value), stmt->line, "%s: operand %d must be a number",
+               atom_str(stmt->instruction.name), i + 1)
+    return value;
+}
+
+// The 16 bit field of an I-type instruction `target` fills, which must fit
+// unless %hi or %lo cut it down. Of an address that is not known yet only a
+// half can be filled in later: the field is left 0 for a fixup of `kind`.
+static uint32_t field16(assembler_t* as, const statement_t* stmt, const target_t* target, bool sign,
+                        const char* what, fixup_kind_t* kind) {
+    const char* name = atom_str(stmt->instruction.name);
+    uint32_t imm = target->num;
+    if (target->part != EXPR_NUMBER) {
+        *kind = target->part == EXPR_HI ? FIXUP_HI16 : FIXUP_LO16;
+        expr_apply(target->part, imm, 0, &imm);
+        return target->sym == ATOM_NONE ? imm : 0;
+    }
+    if (target->sym != ATOM_NONE) {
+        AS_REQUIRE(!expr_symbolic(as), stmt->line, "%s: %s must be a number, %%hi or %%lo", name, what)
+        return 0;
+    }
+    if (sign) {
+        AS_REQUIRE((int32_t) imm >= -32768 && (int32_t) imm <= 32767, stmt->line,
+                   "%s: %s %d does not fit 16 signed bits", name, what, (int32_t) imm)
+    } else {
+        AS_REQUIRE(imm <= 0xffff, stmt->line, "%s: %s 0x%x does not fit 16 bits", name, what, imm)
+    }
+    return imm & 0xffff;
+}
+
+static uint32_t arg_imm16(assembler_t* as, const statement_t* stmt, guint i, bool sign, target_t* target,
+                          fixup_kind_t* kind) {
+    argument_t* arg = arg_at(stmt, i);
+    AS_REQUIRE(arg->type == ARG_NUMBER || arg->type == ARG_EXPR, stmt->line, "%s: operand %d must be a number",
+               atom_str(stmt->instruction.name), i + 1)
+    arg_target(as, stmt, arg, target);
+    return field16(as, stmt, target, sign, "immediate", kind);
+}
+
+static void define_label(assembler_t* as, const statement_t* stmt) {
+    symbol_t* sym = symtab_get(&as->symbols, stmt->label.name);
+    AS_REQUIRE(!sym->defined, stmt->line, "Duplicate label: %s", atom_str(stmt->label.name))
+    sym->defined = true;
+    sym->sector = as->sector;
+    sym->address = address(current(as));
+    sym->line = stmt->line;
+    // a branch to the label must not skip what was before the delay slot
+    as->slot.state = SLOT_NONE;
+
+    // each taken off before it is resolved, after an error the rest is left
+    // to resolve_undefined and none is reported twice
+    fixup_t fixup;
+    while (symtab_take_fixup(&as->symbols, sym, &fixup)) {
+        resolve(as, fixup.kind, fixup.sector, fixup.offset, sym, fixup.addend, fixup.line);
+    }
+}
+
+// Whatever is still pending refers to a symbol that was never defined. With
+// diagnostics every line that uses it is reported once, as
+// assembler_run_parallel does; the fixups of one line are chained next to
+// each other.
+static void resolve_undefined(assembler_t* as) {
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, as->symbols.symbols);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        symbol_t* sym = (symbol_t*) value;
+        volatile int32_t i = sym->fixups;
+        // lines are 1-based
+        volatile uint32_t reported = 0;
+        if (i == FIXUP_NONE) {
+            continue;
+        }
+        if (as->diags != NULL) {
+            if (setjmp(as->recover) != 0) {
+                reported = symtab_fixup(&as->symbols, i)->line;
+                i = symtab_fixup(&as->symbols, i)->next;
+            }
+            as->recovering = true;
+        }
+        for (; i != FIXUP_NONE; i = symtab_fixup(&as->symbols, i)->next) {
+            fixup_t* fixup = symtab_fixup(&as->symbols, i);
+            if (fixup->line == reported) {
+                continue;
+            }
+            resolve(as, fixup->kind, fixup->sector, fixup->offset, sym, fixup->addend, fixup->line);
+        }
+        as->recovering = false;
+        symtab_release_fixups(&as->symbols, sym);
+    }
+}
+
+static const guint layout_argc[] = {
+    [LAYOUT_NONE] = 0,
+    [LAYOUT_RD_RS_RT] = 3,
+    [LAYOUT_RD_RT_SA] = 3,
+    [LAYOUT_RD_RT_RS] = 3,
+    [LAYOUT_RS_RT] = 2,
+    [LAYOUT_RD] = 1,
+    [LAYOUT_RS] = 1,
+    [LAYOUT_RS_LINK] = 1,
+    [LAYOUT_RD_RS] = 2,
+    [LAYOUT_RT_RS_IMM] = 3,
+    [LAYOUT_RT_IMM] = 2,
+    [LAYOUT_RT_MEM] = 2,
+    [LAYOUT_RS_RT_OFF] = 3,
+    [LAYOUT_RS_OFF] = 2,
+    [LAYOUT_TARGET] = 1,
+    [LAYOUT_RT_ADDR] = 2,
+};
+
+// Loading a constant into a register
+
+typedef enum load_step {
+    LOAD_ADDIU,     // addiu rt, $zero, lo
+    LOAD_ORI,       // ori rt, $zero, lo
+    LOAD_LUI,       // lui rt, hi
+    LOAD_ORI_RT,    // ori rt, rt, lo
+} load_step_t;
+
+typedef struct load_form {
+    bool (*fits)(uint32_t value);
+    uint32_t count;
+    load_step_t steps[2];
+} load_form_t;
+
+static bool fits_simm16(uint32_t value) {
+    return value + 0x8000 <= 0xffff;
+}
+
+static bool fits_uimm16(uint32_t value) {
+    return value <= 0xffff;
+}
+
+static bool fits_upper(uint32_t value) {
+    return (value & 0xffff) == 0;
+}
+
+static bool fits_any(uint32_t value) {
+    (void) value;
+    return true;
+}
+
+// Shortest first, the first one that fits is used
+static const load_form_t load_forms[] = {
+    { fits_simm16, 1, { LOAD_ADDIU } },
+    { fits_uimm16, 1, { LOAD_ORI } },
+    { fits_upper, 1, { LOAD_LUI } },
+    { fits_any, 2, { LOAD_LUI, LOAD_ORI_RT } },
+};
+
+static const load_form_t* load_form(uint32_t value) {
+    const load_form_t* form = load_forms;
+    while (!form->fits(value)) {
+        form++;
+    }
+    return form;
+}
+
+static void emit_load(buffer_t* buff, uint32_t rt, uint32_t value) {
+    const load_form_t* form = load_form(value);
+    for (uint32_t i = 0; i < form->count; i++) {
+        switch (form->steps[i]) {
+            case LOAD_ADDIU:
+                emit_word(buff, encode_i(0x09, 0, rt, value));
+                break;
+            case LOAD_ORI:
+                emit_word(buff, encode_i(0x0d, 0, rt, value));
+                break;
+            case LOAD_LUI:
+                emit_word(buff, encode_i(0x0f, 0, rt, value >> 16));
+                break;
+            case LOAD_ORI_RT:
+                emit_word(buff, encode_i(0x0d, rt, rt, value));
+                break;
+        }
+    }
+}
+
+// The address `la` loads, if it is final already. Chunks of a parallel run
+// never know, chunk_merge catches the cases where that makes a difference.
+static bool la_address(assembler_t* as, const target_t* target, uint32_t* value) {
+    if (target->sym == ATOM_NONE) {
+        *value = target->num;
+        return true;
+    }
+    if (as->relocatable || as->deferred) {
+        return false;
+    }
+    const symbol_t* sym = symtab_get(&as->symbols, target->sym);
+    *value = sym->address + target->num;
+    return sym->defined;
+}
+
+static void assemble_pseudo(assembler_t* as, const statement_t* stmt, const opcode_t* op) {
+    buffer_t* buff = current(as);
+    switch ((pseudo_t) op->funct) {
+        case PSEUDO_NOP:
+            emit_word(buff, 0);
+            break;
+        case PSEUDO_MOVE:
+            emit_word(buff, encode_r(arg_reg(stmt, 1), 0, arg_reg(stmt, 0), 0, 0x21));
+            break;
+        case PSEUDO_LI:
+            emit_load(buff, arg_reg(stmt, 0), arg_imm(as, stmt, 1));
+            break;
+        case PSEUDO_LA: {
+            uint32_t rt = arg_reg(stmt, 0);
+            target_t target;
+            uint32_t value;
+            arg_address(as, stmt, arg_at(stmt, 1), &target);
+            // a known address is a constant like any other, but only a single
+            // instruction load is worth giving up the lui/addiu pair for
+            if (la_address(as, &target, &value) && load_form(value)->count == 1) {
+                emit_load(buff, rt, value);
+                break;
+            }
+            emit_ref(as, encode_i(0x0f, 0, rt, 0), &target, FIXUP_HI16, stmt->line);
+            if (as->deferred) {
+                // for chunk_la_differs, a %hi of the same address is never shortened
+                g_array_index(as->references, reference_t, as->references->len - 1).la = true;
+            }
+            emit_ref(as, encode_i(0x09, rt, rt, 0), &target, FIXUP_LO16, stmt->line);
+            break;
+        }
+    }
+}
+
+// Delay slot filling
+
+#define REG_BIT(r) ((r) == 0 ? 0u : 1u << (r))
+
+static inline uint32_t reg_bit(const statement_t* stmt, guint i) {
+    return REG_BIT(arg_at(stmt, i)->reg);
+}
+
+// Registers an already assembled instruction reads and writes, and whether it
+// may move into a delay slot. Loads and hi/lo moves may not, their hazards
+// would land on the branch target; nor may syscall and break.
+static bool slot_registers(const statement_t* stmt, const opcode_t* op, uint32_t* reads, uint32_t* writes) {
+    *reads = 0;
+    *writes = 0;
+    switch (op->layout) {
+        case LAYOUT_RD_RS_RT:
+        case LAYOUT_RD_RT_RS:
+            *reads = reg_bit(stmt, 1) | reg_bit(stmt, 2);
+            *writes = reg_bit(stmt, 0);
+            return true;
+        case LAYOUT_RD_RT_SA:
+        case LAYOUT_RD_RS:
+        case LAYOUT_RT_RS_IMM:
+            *reads = reg_bit(stmt, 1);
+            *writes = reg_bit(stmt, 0);
+            return true;
+        case LAYOUT_RT_IMM:
+        case LAYOUT_RT_ADDR:
+            *writes = reg_bit(stmt, 0);
+            return true;
+        case LAYOUT_RT_MEM: {
+            uint32_t base = REG_BIT(arg_at(stmt, 1)->mem.base);
+            // stores are 0x28 and up
+            if (op->opcode < 0x28) {
+                return false;
+            }
+            *reads = base | reg_bit(stmt, 0);
+            return true;
+        }
+        case LAYOUT_RS_RT_OFF:
+            *reads = reg_bit(stmt, 0) | reg_bit(stmt, 1);
+            return false;
+        case LAYOUT_RS:
+        case LAYOUT_RS_OFF:
+            *reads = reg_bit(stmt, 0);
+            return false;
+        case LAYOUT_RS_LINK:
+            *reads = reg_bit(stmt, 0);
+            *writes = REG_BIT(31);
+            return false;
+        case LAYOUT_TARGET:
+            // jal links
+            *writes = op->opcode == 0x03 ? REG_BIT(31) : 0;
+            return false;
+        default:
+            return false;
+    }
+}
+
+// Takes the last instruction back out of the buffer and returns true if it
+// can go in the delay slot of the branch `stmt` instead. It must neither
+// write what the branch reads nor touch what the branch writes.
+static bool slot_take(assembler_t* as, const statement_t* stmt, const opcode_t* op, uint32_t* word) {
+    if (as->slot.state == SLOT_UNKNOWN) {
+        as->slot_unknown_used = true;
+        return false;
+    }
+    buffer_t* buff = current(as);
+    uint32_t reads, writes;
+    slot_registers(stmt, op, &reads, &writes);
+    if (as->slot.state != SLOT_MOVABLE || as->slot.sector != as->sector || as->slot.offset + 4 != buff->size
+        || (as->slot.writes & reads) != 0 || ((as->slot.reads | as->slot.writes) & writes) != 0) {
+        return false;
+    }
+    *word = buffer_word_at(buff, as->slot.offset);
+    buff->size = as->slot.offset;
+    return true;
+}
+
+// Whether an operand is an expression. Those are left out of delay slot
+// filling: one may be constant in a sequential run but need a fixup in a
+// chunk of a parallel one, which would decide differently.
+static bool has_expr(const statement_t* stmt) {
+    for (uint32_t i = 0; i < stmt->instruction.argc; i++) {
+        const argument_t* arg = arg_at(stmt, i);
+        if (arg->type == ARG_EXPR || (arg->type == ARG_MEMORY && arg->mem.expr.count > 0)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Remembers the instruction just assembled from `start` on if it could fill
+// the delay slot of a branch right after it. It must be a single word without
+// an expression, which also rules out anything with a fixup.
+static void slot_track(assembler_t* as, const statement_t* stmt, const opcode_t* op, uint32_t start) {
+    buffer_t* buff = current(as);
+    uint32_t reads, writes;
+    if (buff->size - start == 4 && !has_expr(stmt) && slot_registers(stmt, op, &reads, &writes)) {
+        slot_t slot = { SLOT_MOVABLE, as->sector, start, reads, writes };
+        as->slot = slot;
+    } else {
+        as->slot.state = SLOT_NONE;
+    }
+}
+
+static void assemble_instruction(assembler_t* as, const statement_t* stmt) {
+    const char* name = atom_str(stmt->instruction.name);
+    const opcode_t* op = opcode_from_atom(stmt->instruction.name);
+    AS_REQUIRE(op != NULL, stmt->line, "Unknown instruction: %s", name)
+    AS_REQUIRE(as->sector != SECTOR_DATA, stmt->line, "Instruction %s outside of .text", name)
+    if (as->sector == SECTOR_INHERIT && as->inherit_text_line == 0) {
+        as->inherit_text_line = stmt->line;
+    }
+    AS_REQUIRE(stmt->instruction.argc == layout_argc[op->layout], stmt->line,
+               "%s expects %d operands, found %d", name, layout_argc[op->layout],
+               stmt->instruction.argc)
+
+    // one capacity check covers every word the statement expands to
+    buffer_t* buff = current(as);
+    buffer_reserve(buff, BUFFER_WORDS(MAX_STATEMENT_WORDS));
+    uint32_t start = buff->size;
+
+    if (op->format == FMT_PSEUDO) {
+        assemble_pseudo(as, stmt, op);
+        if (as->optimize) {
+            slot_track(as, stmt, op, start);
+        }
+        return;
+    }
+
+    uint32_t word = 0;
+    target_t target;
+    bool ref = false;
+    fixup_kind_t kind = FIXUP_WORD32;
+    bool sign = (op->flags & OPF_SIGNED) != 0;
+
+    switch (op->layout) {
+        case LAYOUT_NONE:
+            word = encode_r(0, 0, 0, 0, op->funct);
+            break;
+        case LAYOUT_RD_RS_RT:
+            word = encode_r(arg_reg(stmt, 1), arg_reg(stmt, 2), arg_reg(stmt, 0), 0, op->funct);
+            break;
+        case LAYOUT_RD_RT_SA: {
+            uint32_t sa = arg_imm(as, stmt, 2);
+            AS_REQUIRE(sa < 32, stmt->line, "%s: shift amount %d out of range", name, sa)
+            word = encode_r(0, arg_reg(stmt, 1), arg_reg(stmt, 0), sa, op->funct);
+            break;
+        }
+        case LAYOUT_RD_RT_RS:
+            word = encode_r(arg_reg(stmt, 2), arg_reg(stmt, 1), arg_reg(stmt, 0), 0, op->funct);
+            break;
+        case LAYOUT_RS_RT:
+            word = encode_r(arg_reg(stmt, 0), arg_reg(stmt, 1), 0, 0, op->funct);
+            break;
+        case LAYOUT_RD:
+            word = encode_r(0, 0, arg_reg(stmt, 0), 0, op->funct);
+            break;
+        case LAYOUT_RS:
+            word = encode_r(arg_reg(stmt, 0), 0, 0, 0, op->funct);
+            break;
+        case LAYOUT_RS_LINK:
+            word = encode_r(arg_reg(stmt, 0), 0, 31, 0, op->funct);
+            break;
+        case LAYOUT_RT_RS_IMM:
+            word = encode_i(op->opcode, arg_reg(stmt, 1), arg_reg(stmt, 0),
+                            arg_imm16(as, stmt, 2, sign, &target, &kind));
+            // %hi or %lo of an address not known yet
+            ref = target.sym != ATOM_NONE;
+            break;
+        case LAYOUT_RT_IMM:
+            word = encode_i(op->opcode, 0, arg_reg(stmt, 0), arg_imm16(as, stmt, 1, sign, &target, &kind));
+            ref = target.sym != ATOM_NONE;
+            break;
+        case LAYOUT_RT_MEM: {
+            argument_t* mem = arg_at(stmt, 1);
+            AS_REQUIRE(mem->type == ARG_MEMORY, stmt->line, "%s: operand 2 must be offset($reg)", name)
+            target = (target_t) { ATOM_NONE, mem->mem.offset, EXPR_NUMBER };
+            if (mem->mem.expr.count > 0) {
+                expr_target(as, stmt, mem->mem.expr, &target);
+            }
+            word = encode_i(op->opcode, mem->mem.base, arg_reg(stmt, 0),
+                            field16(as, stmt, &target, true, "offset", &kind));
+            ref = target.sym != ATOM_NONE;
+            break;
+        }
+        case LAYOUT_RS_RT_OFF:
+            word = encode_i(op->opcode, arg_reg(stmt, 0), arg_reg(stmt, 1), 0);
+            arg_address(as, stmt, arg_at(stmt, 2), &target);
+            ref = true;
+            kind = FIXUP_PC16;
+            break;
+        case LAYOUT_RS_OFF:
+            // funct holds the fixed rt field (REGIMM condition for bltz/bgez)
+            word = encode_i(op->opcode, arg_reg(stmt, 0), op->funct, 0);
+            arg_address(as, stmt, arg_at(stmt, 1), &target);
+            ref = true;
+            kind = FIXUP_PC16;
+            break;
+        case LAYOUT_TARGET:
+            word = encode_j(op->opcode, 0);
+            arg_address(as, stmt, arg_at(stmt, 0), &target);
+            ref = true;
+            kind = FIXUP_J26;
+            break;
+        default:
+            FATAL("Invalid layout for %s\n", name)
+    }
+
+    uint32_t delayed = 0;
+    bool filled = as->optimize && (op->flags & OPF_DELAY) && slot_take(as, stmt, op, &delayed);
+
+    if (ref) {
+        emit_ref(as, word, &target, kind, stmt->line);
+    } else {
+        emit_word(buff, word);
+    }
+
+    if (op->flags & OPF_DELAY) {
+        // the instruction taken out above, or a nop
+        emit_word(buff, delayed);
+        as->delay_slots++;
+        as->delay_filled += filled;
+        as->slot.state = SLOT_NONE;
+    } else if (as->optimize) {
+        slot_track(as, stmt, op, start);
+    }
+}
+
+// Whether padding the section to `align` and adding `len` bytes keeps its
+// addresses below 2^32
+static bool section_fits(const buffer_t* buff, uint32_t align, uint32_t len) {
+    uint64_t end = (uint64_t) buff->base + buff->size;
+    end = (end + align - 1) / align * align + len;
+    return end <= (uint64_t) UINT32_MAX + 1;
+}
+
+static void assemble_directive(assembler_t* as, const statement_t* stmt) {
+    const char* name = atom_str(stmt->directive.name);
+    argument_t* arg = stmt->directive.argument;
+    buffer_t* buff = current(as);
+    uint32_t value;
+    as->slot.state = SLOT_NONE;
+
+    directive_t directive = directive_from_atom(stmt->directive.name);
+    switch (directive) {
+        case DIR_TEXT:
+            as->sector = SECTOR_TEXT;
+            break;
+        case DIR_DATA:
+            as->sector = SECTOR_DATA;
+            break;
+        case DIR_GLOBL:
+        case DIR_GLOBAL:
+            AS_REQUIRE(arg != NULL && arg->type == ARG_SYMBOL, stmt->line, ".%s expects a symbol", name)
+            symtab_get(&as->symbols, arg->sym)->global = true;
+            break;
+        case DIR_WORD: {
+            AS_REQUIRE(arg != NULL && (arg->type == ARG_NUMBER || arg->type == ARG_SYMBOL || arg->type == ARG_EXPR),
+                       stmt->line, ".word expects a number or a symbol")
+            target_t target;
+            arg_address(as, stmt, arg, &target);
+            buffer_reserve(buff, BUFFER_WORDS(1));
+            emit_ref(as, 0, &target, FIXUP_WORD32, stmt->line);
+            break;
+        }
+        case DIR_HALF: {
+            AS_REQUIRE(arg != NULL && arg_constant(as, stmt, arg, &value), stmt->line, ".half expects a number")
+            uint16_t half = buffer_to_target16(buff, (uint16_t) value);
+            buffer_align(buff, 2);
+            buffer_push(buff, (uint8_t*) &half, sizeof(half));
+            break;
+        }
+        case DIR_BYTE: {
+            AS_REQUIRE(arg != NULL && arg_constant(as, stmt, arg, &value), stmt->line, ".byte expects a number")
+            uint8_t byte = (uint8_t) value;
+            buffer_push(buff, &byte, 1);
+            break;
+        }
+        case DIR_ASCII:
+        case DIR_ASCIIZ:
+            AS_REQUIRE(arg != NULL && arg->type == ARG_STRING, stmt->line, ".%s expects a string", name)
+            buffer_push(buff, (const uint8_t*) arg->string.ptr, arg->string.len);
+            if (directive == DIR_ASCIIZ) {
+                buffer_fill(buff, 0, 1);
+            }
+            break;
+        case DIR_SPACE:
+            AS_REQUIRE(arg != NULL && arg_constant(as, stmt, arg, &value), stmt->line, ".space expects a number")
+            AS_REQUIRE(section_fits(buff, 1, value), stmt->line, "Section too large")
+            buffer_fill(buff, 0, value);
+            break;
+        case DIR_ALIGN:
+            AS_REQUIRE(arg != NULL && arg_constant(as, stmt, arg, &value) && value < 16, stmt->line,
+                       ".align expects a power of 2")
+            AS_REQUIRE(section_fits(buff, 1u << value, 0), stmt->line, "Section too large")
+            buffer_align(buff, 1u << value);
+            break;
+        case DIR_UNKNOWN:
+            AS_REQUIRE(false, stmt->line, "Unknown directive: .%s", name)
+    }
+}
+
+static void assemble_statement(assembler_t* as, const statement_t* stmt) {
+    switch (stmt->type) {
+        case STMT_DIRECTIVE:
+            assemble_directive(as, stmt);
+            break;
+        case STMT_INSTRUCTION:
+            assemble_instruction(as, stmt);
+            break;
+        case STMT_LABEL:
+            define_label(as, stmt);
+            break;
+    }
+}
+
+// Assembles the statements of a block. With diagnostics, an error ends its
+// statement only.
+static void assemble_block(assembler_t* as, const ir_block_t* block) {
+    volatile uint32_t i = 0;
+    if (as->diags != NULL) {
+        if (setjmp(as->recover) != 0) {
+            i++;
+        }
+        as->recovering = true;
+    }
+    for (; i < block->count; i++) {
+        statement_t stmt;
+        ir_get(block, i, &stmt);
+        assemble_statement(as, &stmt);
+    }
+    as->recovering = false;
 }
 
 void assembler_run(assembler_t* as) {
+    uint64_t start = 0, before = 0;
+    if (as->stats != NULL) {
+        start = stats_now();
+        before = stats_nanos(as->stats);
+    }
+
+    parser_t* parser = as->parser = g_new(parser_t, 1);
+    parser_init(parser, as->src, as->len);
+    parser_set_line(parser, as->line);
+    parser_set_path(parser, as->path);
+    parser_set_stats(parser, as->stats);
+    parser_set_diagnostics(parser, as->diags);
+    recover_begin(as);
+
+    ir_block_t* block = as->block = g_new(ir_block_t, 1);
+    ir_init(block);
+    while (parser_fill(parser, block)) {
+        assemble_block(as, block);
+        if (as->stats != NULL) {
+            as->stats->phases[PHASE_ASSEMBLE].items += block->count;
+        }
+    }
+    release_parser(as);
+    if (!as->deferred) {
+        resolve_undefined(as);
+    }
+    recover_end(as);
+
+    if (as->stats != NULL) {
+        // the IR block, parser_fill only sees it grow
+        as->stats->phases[PHASE_PARSE].allocations++;
+        phase_stats_t* assemble = &as->stats->phases[PHASE_ASSEMBLE];
+        assemble->nanos += stats_now() - start - (stats_nanos(as->stats) - before);
+        assemble->bytes += as->textbuff.size + as->databuff.size + as->inheritbuff.size;
+        count_allocations(as);
+    }
+}
+
+// Parallel assembly
+
+// Chunks smaller than this are not worth a thread
+#define CHUNK_MIN_SIZE (64 * 1024)
+
+typedef struct chunk {
+    const char* src;
+    uint32_t len;
+    uint32_t line;
+
+    assembler_t unit;
+    GThread* thread;
+    // bytes the unit's text and data buffers were pre-filled with
+    uint32_t phase[2];
+
+    // section in effect at the start of the chunk, known after merging
+    sector_t inherited;
+    // offset in the final section of offset 0 of each unit buffer
+    uint32_t delta[3];
+    // counters of the unit, including any run thrown away by chunk_merge
+    stats_t stats;
+    // errors of the unit's last run, if the parent collects them
+    diagnostics_t diags;
+} chunk_t;
+
+static void chunk_unit_init(assembler_t* as, chunk_t* chunk, sector_t sector, uint32_t textphase,
+                            uint32_t dataphase) {
+    assembler_t* unit = &chunk->unit;
+    *unit = assembler_new(chunk->src, chunk->len);
+    assembler_set_big_endian(unit, as->big_endian);
+    assembler_set_stats(unit, as->stats != NULL ? &chunk->stats : NULL);
+    assembler_set_optimize(unit, as->optimize);
+    diag_init(&chunk->diags);
+    assembler_set_diagnostics(unit, as->diags != NULL ? &chunk->diags : NULL);
+    unit->slot.state = SLOT_UNKNOWN;
+    unit->line = chunk->line;
+    unit->deferred = true;
+    unit->references = g_array_new(FALSE, FALSE, sizeof(reference_t));
+    unit->sector = sector;
+    unit->textbuff.base = 0;
+    unit->databuff.base = 0;
+    // Starting at the same offset modulo the largest alignment makes .align
+    // pad exactly as it would have in a sequential run.
+    buffer_fill(&unit->textbuff, 0, textphase);
+    buffer_fill(&unit->databuff, 0, dataphase);
+    chunk->phase[SECTOR_TEXT] = textphase;
+    chunk->phase[SECTOR_DATA] = dataphase;
+}
 
+static gpointer chunk_worker(gpointer data) {
+    assembler_run(&((chunk_t*) data)->unit);
+    return NULL;
 }
 
+// Splits the source into at most `jobs` chunks of whole lines
+static uint32_t chunk_split(const char* src, size_t len, uint32_t line, uint32_t jobs, chunk_t* chunks) {
+    size_t target = len / jobs, begin = 0;
+    uint32_t count = 0;
 
+    while (begin < len) {
+        size_t end = len;
+        if (count + 1 < jobs && begin + target < len) {
+            end = scan_line_end(src, begin + target, len);
+            end = MIN(end + 1, len);
+        }
+        chunks[count].src = src + begin;
+        chunks[count].len = (uint32_t) (end - begin);
+        chunks[count].line = line;
+        count++;
+
+        for (size_t nl = begin; (nl = scan_line_end(src, nl, end)) < end; nl++) {
+            line++;
+        }
+        begin = end;
+    }
+    return count;
+}
+
+static inline bool chunk_fits(const buffer_t* buff, uint32_t delta) {
+    return delta % buff->align == 0;
+}
+
+// Whether a sequential run would have shortened an `la` of the chunk, now
+// that the chunk's addresses are known. That happens when the symbol was
+// defined before the `la`, in this chunk or an earlier one, at an address a
+// single instruction loads.
+static bool chunk_la_differs(assembler_t* as, chunk_t* chunk, sector_t sector) {
+    if (as->relocatable) {
+        return false;
+    }
+    GArray* refs = chunk->unit.references;
+    for (guint i = 0; i < refs->len; i++) {
+        const reference_t* ref = &g_array_index(refs, reference_t, i);
+        if (!ref->la || ref->symbol == ATOM_NONE) {
+            continue;
+        }
+        const symbol_t* sym = g_hash_table_lookup(chunk->unit.symbols.symbols, GUINT_TO_POINTER(ref->symbol));
+        uint32_t value;
+        if (sym != NULL && sym->defined) {
+            sector_t s = sym->sector == SECTOR_INHERIT ? sector : sym->sector;
+            value = sector_buffer(as, s)->base + chunk->delta[sym->sector] + sym->address + ref->value;
+        } else {
+            sym = g_hash_table_lookup(as->symbols.symbols, GUINT_TO_POINTER(ref->symbol));
+            if (sym == NULL || !sym->defined) {
+                continue;
+            }
+            value = sym->address + ref->value;
+        }
+        if (sym->line <= ref->line && load_form(value)->count == 1) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Appends a finished chunk to the output. If its alignment padding cannot be
+// right where it lands, or it emitted instructions without knowing it would
+// end up in .data, it is assembled again with the actual starting state.
+// Returns false without merging anything if the chunk's `la` expansions are
+// not those of a sequential run, or an expression needs earlier addresses.
+static bool chunk_merge(assembler_t* as, chunk_t* chunk) {
+    sector_t sector = as->sector;
+    sector_t other = sector == SECTOR_TEXT ? SECTOR_DATA : SECTOR_TEXT;
+    buffer_t* out = sector_buffer(as, sector);
+    buffer_t* outother = sector_buffer(as, other);
+    assembler_t* unit = &chunk->unit;
+
+    uint32_t inherit_at = out->size;
+    uint32_t sector_at = out->size + unit->inheritbuff.size;
+    bool fits = chunk_fits(&unit->inheritbuff, inherit_at)
+        && chunk_fits(sector_buffer(unit, sector), sector_at - chunk->phase[sector])
+        && chunk_fits(sector_buffer(unit, other), outother->size - chunk->phase[other])
+        && !(sector == SECTOR_DATA && unit->inherit_text_line != 0);
+
+    if (!fits) {
+        assembler_free(unit);
+        chunk_unit_init(as, chunk, sector, as->textbuff.size & (BUFFER_MAX_ALIGN - 1),
+                        as->databuff.size & (BUFFER_MAX_ALIGN - 1));
+        assembler_run(unit);
+        sector_at = out->size;
+    }
+
+    chunk->inherited = sector;
+    chunk->delta[SECTOR_INHERIT] = inherit_at;
+    chunk->delta[sector] = sector_at - chunk->phase[sector];
+    chunk->delta[other] = outother->size - chunk->phase[other];
+    // a branch at the start of the chunk may have been able to take the
+    // last instruction of the one before
+    if (unit->expr_unresolved || chunk_la_differs(as, chunk, sector)
+        || (unit->slot_unknown_used && as->slot.state == SLOT_MOVABLE)) {
+        return false;
+    }
+
+    buffer_push(out, unit->inheritbuff.data, unit->inheritbuff.size);
+    out->align = MAX(out->align, unit->inheritbuff.align);
+    for (uint32_t s = SECTOR_TEXT; s <= SECTOR_DATA; s++) {
+        buffer_t* from = sector_buffer(unit, s);
+        if (from->size > chunk->phase[s]) {
+            buffer_push(sector_buffer(as, s), from->data + chunk->phase[s], from->size - chunk->phase[s]);
+        }
+        sector_buffer(as, s)->align = MAX(sector_buffer(as, s)->align, from->align);
+    }
+
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, unit->symbols.symbols);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        symbol_t* local = (symbol_t*) value;
+        symbol_t* sym = symtab_get(&as->symbols, local->name);
+        sym->global |= local->global;
+        if (!local->defined) {
+            continue;
+        }
+        if (sym->defined) {
+            as_report(as, local->line, "Duplicate label: %s", atom_str(local->name));
+            continue;
+        }
+        sym->defined = true;
+        sym->sector = local->sector == SECTOR_INHERIT ? sector : local->sector;
+        sym->address = sector_buffer(as, sym->sector)->base + chunk->delta[local->sector] + local->address;
+        sym->line = local->line;
+    }
+
+    if (unit->sector != SECTOR_INHERIT) {
+        as->sector = unit->sector;
+    }
+    as->delay_slots += unit->delay_slots;
+    as->delay_filled += unit->delay_filled;
+    if (unit->slot.state == SLOT_MOVABLE) {
+        as->slot = unit->slot;
+        as->slot.sector = unit->slot.sector == SECTOR_INHERIT ? sector : unit->slot.sector;
+        as->slot.offset += chunk->delta[unit->slot.sector];
+    } else if (unit->slot.state == SLOT_NONE) {
+        as->slot.state = SLOT_NONE;
+    }
+    if (as->diags != NULL) {
+        diag_append(as->diags, &chunk->diags);
+    }
+    return true;
+}
+
+static void chunk_resolve(assembler_t* as, chunk_t* chunk) {
+    GArray* refs = chunk->unit.references;
+    volatile guint i = 0;
+    // the last reference reported, those of one line follow each other and
+    // an undefined symbol is reported once per line
+    volatile atom_t reported_symbol = ATOM_NONE;
+    volatile uint32_t reported_line = 0;
+    if (as->diags != NULL) {
+        if (setjmp(as->recover) != 0) {
+            reported_symbol = g_array_index(refs, reference_t, i).symbol;
+            reported_line = g_array_index(refs, reference_t, i).line;
+            i++;
+        }
+        as->recovering = true;
+    }
+    for (; i < refs->len; i++) {
+        reference_t* ref = &g_array_index(refs, reference_t, i);
+        if (ref->symbol != ATOM_NONE && ref->symbol == reported_symbol && ref->line == reported_line) {
+            continue;
+        }
+        uint32_t value = ref->value;
+        uint32_t sector = ref->sector == SECTOR_INHERIT ? chunk->inherited : ref->sector;
+        uint32_t offset = chunk->delta[ref->sector] + ref->offset;
+        if (ref->symbol != ATOM_NONE) {
+            resolve(as, ref->kind, sector, offset, symtab_get(&as->symbols, ref->symbol), value, ref->line);
+        } else {
+            resolve_value(as, ref->kind, sector, offset, value, ref->line);
+        }
+    }
+    as->recovering = false;
+}
+
+void assembler_run_parallel(assembler_t* as, uint32_t jobs) {
+    jobs = MIN(jobs, (uint32_t) (as->len / CHUNK_MIN_SIZE));
+    if (jobs <= 1 || pp_mentions(as->src, as->len, "include") || pp_mentions(as->src, as->len, "macro")
+        || pp_mentions(as->src, as->len, "equ")) {
+        assembler_run(as);
+        return;
+    }
+
+    chunk_t* chunks = g_new0(chunk_t, jobs);
+    uint32_t count = chunk_split(as->src, as->len, as->line, jobs, chunks);
+    recover_begin(as);
+
+    for (uint32_t i = 0; i < count; i++) {
+        // only the first chunk knows it starts in .text
+        chunk_unit_init(as, &chunks[i], i == 0 ? as->sector : SECTOR_INHERIT, 0, 0);
+        chunks[i].thread = g_thread_new("asm-chunk", chunk_worker, &chunks[i]);
+    }
+
+    // merge in order while later chunks are still running
+    uint64_t merging = 0;
+    uint32_t merged = 0;
+    for (; merged < count; merged++) {
+        g_thread_join(chunks[merged].thread);
+        uint64_t start = as->stats != NULL ? stats_now() : 0;
+        uint64_t rerun = as->stats != NULL ? stats_nanos(&chunks[merged].stats) : 0;
+        bool ok = chunk_merge(as, &chunks[merged]);
+        if (as->stats != NULL) {
+            merging += stats_now() - start - (stats_nanos(&chunks[merged].stats) - rerun);
+        }
+        if (!ok) {
+            break;
+        }
+    }
+
+    if (merged < count) {
+        // everything from here on is assembled in order, with final addresses
+        for (uint32_t i = merged + 1; i < count; i++) {
+            g_thread_join(chunks[i].thread);
+        }
+        const char* src = as->src;
+        size_t len = as->len;
+        uint32_t line = as->line;
+        as->src = chunks[merged].src;
+        as->len = len - (size_t) (chunks[merged].src - src);
+        as->line = chunks[merged].line;
+        assembler_run(as);
+        as->src = src;
+        as->len = len;
+        as->line = line;
+    }
+
+    uint64_t start = as->stats != NULL ? stats_now() : 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (i < merged) {
+            chunk_resolve(as, &chunks[i]);
+        }
+        if (as->stats != NULL) {
+            stats_add(as->stats, &chunks[i].stats);
+        }
+        assembler_free(&chunks[i].unit);
+    }
+    g_free(chunks);
+    recover_end(as);
+
+    if (as->stats != NULL) {
+        as->stats->phases[PHASE_ASSEMBLE].nanos += merging + stats_now() - start;
+        as->stats->threads = count;
+        count_allocations(as);
+    }
+}
@@ -2,22 +2,127 @@
 #define ASM_ASSEMBLER_H
 
 #include "buffer.h"
+#include "symbols.h"
+#include "stats.h"
+#include "diag.h"
+#include <setjmp.h>
 #include <stddef.h>
 #include <glib.h>
 
+#define TEXT_BASE 0x00400000
+#define DATA_BASE 0x10010000
+
 typedef enum sector {
     SECTOR_TEXT,
-    SECTOR_DATA
+    SECTOR_DATA,
+    // A chunk assembled in parallel does not know the section in effect at
+    // its start; whatever it emits before its first .text/.data goes here.
+    SECTOR_INHERIT,
+    // target of relocations against absolute addresses
+    SECTOR_ABSOLUTE,
 } sector_t;
 
+typedef enum slot_state {
+    SLOT_NONE,
+    // the last instruction may move into the delay slot of a branch
+    SLOT_MOVABLE,
+    // start of a parallel chunk, the last instruction is in another chunk
+    SLOT_UNKNOWN,
+} slot_state_t;
+
+// The last instruction emitted, as far as delay slot filling is concerned.
+// Register sets are bit masks, $zero is never included.
+typedef struct slot {
+    slot_state_t state;
+    uint32_t sector;
+    uint32_t offset;
+    uint32_t reads;
+    uint32_t writes;
+} slot_t;
+
 typedef struct assembler {
     buffer_t textbuff;
     buffer_t databuff;
+    buffer_t inheritbuff;
     sector_t sector;
-    GQueue* tokens;
+    symtab_t symbols;
+
+    // Set for chunks of a parallel run: buffer addresses are not final, so
+    // every reference is recorded in `references` and resolved at merge time.
+    bool deferred;
+    GArray* references;
+    // first instruction emitted into SECTOR_INHERIT, 0 if none
+    uint32_t inherit_text_line;
+
+    // Relocatable output: sections start at 0 and references to symbols
+    // become `relocations` instead of being patched
+    bool relocatable;
+    GArray* relocations;
+    bool big_endian;
+
+    // Fill branch delay slots with the instruction before the branch where
+    // that does not change what either of them computes
+    bool optimize;
+    slot_t slot;
+    uint32_t delay_slots;
+    uint32_t delay_filled;
+    // set if a chunk starts with a branch, whose slot depends on the chunk before
+    bool slot_unknown_used;
+    // set if a chunk met an expression that may need the addresses of earlier
+    // chunks, it is assembled again in order then
+    bool expr_unresolved;
+
+    // counters of every phase are added here if set
+    stats_t* stats;
+
+    // Errors are recorded here if set, and assembly goes on with the next
+    // statement; otherwise the first error is fatal. An error jumps to
+    // `recover` while `recovering` is set, elsewhere it is passed on to the
+    // handler in effect before the run.
+    diagnostics_t* diags;
+    jmp_buf recover;
+    bool recovering;
+    uint32_t handler_depth;
+    fatal_handler_t outer_handler;
+    gpointer outer_data;
+
+    // Parser and IR block of the run in progress. They live on the heap so
+    // that assembler_free can release them after an error handler jumped
+    // out of the run.
+    struct parser* parser;
+    struct ir_block* block;
+
+    const char* src;
+    size_t len;
+    // line number of src[0]
+    uint32_t line;
+    // file the source was read from, NULL if none
+    const char* path;
 } assembler_t;
 
 assembler_t assembler_new(const char* src, size_t len);
 void assembler_run(assembler_t* as);
 
+// Forgets all output and starts over on `src`, keeping the settings and the
+// allocated buffers
+void assembler_reset(assembler_t* as, const char* src, size_t len);
+
+// Both must be set before running
+void assembler_set_relocatable(assembler_t* as, bool relocatable);
+void assembler_set_big_endian(assembler_t* as, bool big_endian);
+void assembler_set_optimize(assembler_t* as, bool optimize);
+void assembler_set_stats(assembler_t* as, stats_t* stats);
+// .include resolves against the directory of `path`, or the working
+// directory if there is none
+void assembler_set_path(assembler_t* as, const char* path);
+// Records errors in `diags` instead of stopping at the first one
+void assembler_set_diagnostics(assembler_t* as, diagnostics_t* diags);
+
+// Splits the source at line boundaries and assembles up to `jobs` chunks on
+// worker threads, then merges them into `as`. The output is identical to
+// assembler_run. Sources using .include, .macro or .equ are assembled in one
+// piece, a chunk would not see what earlier ones define.
+void assembler_run_parallel(assembler_t* as, uint32_t jobs);
+void assembler_free(assembler_t* as);
+
 #endif //ASM_ASSEMBLER_H
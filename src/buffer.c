@@ -1,7 +1,6 @@
 #include "buffer.h"
 
 #include <memory.h>
-#include <glib.h>
 
 #define BUFF_INITIAL_SIZE (4 * 4)
 
@@ -10,29 +9,98 @@ buffer_t buffer_create() {
     buff.data = calloc(BUFF_INITIAL_SIZE, 1);
     buff.size = 0;
     buff.capacity = BUFF_INITIAL_SIZE;
+    buff.base = 0;
+    buff.align = 1;
+    buff.big_endian = false;
+    buff.allocations = 1;
     return buff;
 }
 
+void buffer_free(buffer_t* buff) {
+    free(buff->data);
+    buff->data = NULL;
+    buff->size = 0;
+    buff->capacity = 0;
+}
+
 #define ALIGN(x, n) ((x) % (n) == 0 ? (x) : (x) + ((n) - (x) % (n)))
 
-static inline void buffer_resize(buffer_t* buff, uint32_t min) {
-    uint32_t newsize1 = ALIGN(buff->size * 3 / 2, 4);
-    uint32_t newsize2 = ALIGN(min, 4);
-    buff->capacity = MAX(newsize1, newsize2);
+void buffer_grow(buffer_t* buff, uint32_t min) {
+    // double the capacity, not the size, so a run of small pushes reallocates
+    // a logarithmic number of times
+    uint64_t capacity = MAX(buff->capacity, BUFF_INITIAL_SIZE);
+    while (capacity < min) {
+        capacity *= 2;
+    }
+    capacity = MIN(capacity, UINT32_MAX & ~3u);
+    if (capacity < min) {
+        FATAL("Section too large\n")
+    }
+    buff->capacity = (uint32_t) capacity;
     buff->data = realloc(buff->data, buff->capacity);
+    buff->allocations++;
+    if (buff->data == NULL) {
+        FATAL("Out of memory\n")
+    }
 }
 
-uint32_t buffer_push_aligned(buffer_t* buff, uint8_t* data, uint32_t len) {
-    uint32_t addr = ALIGN(buff->size, 4);
-    if (buff->capacity <= addr + len) {
-        buffer_resize(buff, addr + len);
+// Offset of the first multiple of `n` at or after the end
+static inline uint32_t buffer_aligned_end(const buffer_t* buff, uint32_t n) {
+    uint32_t padding = (n - buff->size % n) % n;
+    if (padding > UINT32_MAX - buff->size) {
+        FATAL("Section too large\n")
     }
-    memcpy(buff->data, data, len);
+    return buff->size + padding;
+}
+
+static inline uint32_t buffer_push_at(buffer_t* buff, uint32_t addr, const uint8_t* data, uint32_t len) {
+    if (len > UINT32_MAX - addr) {
+        FATAL("Section too large\n")
+    }
+    if (buff->capacity < addr + len) {
+        buffer_grow(buff, addr + len);
+    }
+    // zero any alignment padding between the old end and addr
+    memset(buff->data + buff->size, 0, addr - buff->size);
+    if (len > 0) {
+        memcpy(buff->data + addr, data, len);
+    }
+    buff->size = addr + len;
     return addr + buff->base;
 }
 
+uint32_t buffer_push(buffer_t* buff, const uint8_t* data, uint32_t len) {
+    return buffer_push_at(buff, buff->size, data, len);
+}
+
+uint32_t buffer_push_aligned(buffer_t* buff, const uint8_t* data, uint32_t len) {
+    buff->align = MAX(buff->align, 4);
+    return buffer_push_at(buff, buffer_aligned_end(buff, 4), data, len);
+}
+
+uint32_t buffer_align(buffer_t* buff, uint32_t n) {
+    buff->align = MAX(buff->align, n);
+    return buffer_push_at(buff, buffer_aligned_end(buff, n), NULL, 0);
+}
+
+uint32_t buffer_fill(buffer_t* buff, uint8_t value, uint32_t len) {
+    uint32_t addr = buff->size;
+    buffer_reserve(buff, len);
+    memset(buff->data + addr, value, len);
+    buff->size = addr + len;
+    return addr + buff->base;
+}
+
+// Slack below this is not worth copying the contents for
+#define BUFF_FIT_SLACK 4096
+
 void buffer_fit(buffer_t* buff) {
     // make size multiple of 4 rounding up
-    buff->capacity = ALIGN(buff->size, 4);
+    uint32_t capacity = MAX(ALIGN(buff->size, 4), BUFF_INITIAL_SIZE);
+    if (capacity >= buff->capacity || buff->capacity - capacity < MAX(BUFF_FIT_SLACK, buff->capacity / 4)) {
+        return;
+    }
+    buff->capacity = capacity;
     buff->data = realloc(buff->data, buff->capacity);
+    buff->allocations++;
 }
@@ -3,15 +3,85 @@
 
 #include <mips-as/prelude.h>
 
+#include <string.h>
+
 typedef struct buffer {
     uint8_t* data;
     uint32_t size;
     uint32_t capacity;
     uint32_t base;
+    // largest alignment requested so far, the layout of the contents only
+    // depends on the start address modulo this
+    uint32_t align;
+    // byte order words and halves are stored in, that of the target
+    bool big_endian;
+    // times `data` was (re)allocated, for --stats
+    uint32_t allocations;
 } buffer_t;
 
+// Largest alignment buffer_align accepts
+#define BUFFER_MAX_ALIGN (1u << 15)
+
 buffer_t buffer_create();
-uint32_t buffer_push_aligned(buffer_t* buff, uint8_t* data, uint32_t len);
+void buffer_free(buffer_t* buff);
+
+// Grows the capacity geometrically to at least `min` bytes
+void buffer_grow(buffer_t* buff, uint32_t min);
+
+// Makes room for `len` more bytes. Emits that fit in the reserved space do
+// not check the capacity again.
+static inline void buffer_reserve(buffer_t* buff, uint32_t len) {
+    if (buff->capacity - buff->size < len) {
+        // the end must not wrap before buffer_grow can check it
+        if (len > UINT32_MAX - buff->size) {
+            FATAL("Section too large\n")
+        }
+        buffer_grow(buff, buff->size + len);
+    }
+}
+
+static inline uint32_t buffer_to_target32(const buffer_t* buff, uint32_t value) {
+    return buff->big_endian ? GUINT32_TO_BE(value) : GUINT32_TO_LE(value);
+}
+
+static inline uint16_t buffer_to_target16(const buffer_t* buff, uint16_t value) {
+    return buff->big_endian ? GUINT16_TO_BE(value) : GUINT16_TO_LE(value);
+}
+
+static inline uint32_t buffer_word_at(const buffer_t* buff, uint32_t offset) {
+    uint32_t word;
+    memcpy(&word, buff->data + offset, sizeof(word));
+    return buffer_to_target32(buff, word);
+}
+
+static inline void buffer_set_word_at(buffer_t* buff, uint32_t offset, uint32_t word) {
+    word = buffer_to_target32(buff, word);
+    memcpy(buff->data + offset, &word, sizeof(word));
+}
+
+// Space to reserve for `n` words, including the padding before the first one
+#define BUFFER_WORDS(n) (4 * (n) + 3)
+
+// Appends a word at the next word boundary without checking the capacity,
+// the caller must have reserved BUFFER_WORDS(n) for its n words.
+static inline uint32_t buffer_emit_word(buffer_t* buff, uint32_t word) {
+    uint32_t offset = (buff->size + 3) & ~3u;
+    for (uint32_t i = buff->size; i < offset; i++) {
+        buff->data[i] = 0;
+    }
+    buffer_set_word_at(buff, offset, word);
+    buff->size = offset + sizeof(word);
+    buff->align = MAX(buff->align, 4);
+    return buff->base + offset;
+}
+
+// All push functions return the address (base + offset) of the pushed data.
+uint32_t buffer_push(buffer_t* buff, const uint8_t* data, uint32_t len);
+uint32_t buffer_push_aligned(buffer_t* buff, const uint8_t* data, uint32_t len);
+uint32_t buffer_align(buffer_t* buff, uint32_t n);
+uint32_t buffer_fill(buffer_t* buff, uint8_t value, uint32_t len);
+
+// Releases unused capacity, if there is enough of it to be worth a realloc
 void buffer_fit(buffer_t* buff);
 
 #endif //ASM_BUFFER_H
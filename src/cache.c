@@ -0,0 +1,241 @@
+#include "cache.h"
+#include "parse/preproc.h"
+
+#include <string.h>
+
+#ifndef ASM_VERSION
+#define ASM_VERSION "unknown"
+#endif
+
+// Bump whenever the layout below or the meaning of the output changes
+#define CACHE_FORMAT 4
+
+static const char cache_magic[4] = { 'M', 'A', 'S', 'C' };
+
+typedef struct cache_header {
+    char magic[4];
+    uint32_t format;
+    uint32_t textsize;
+    uint32_t textalign;
+    uint32_t datasize;
+    uint32_t dataalign;
+    uint32_t symbols;
+    uint32_t relocations;
+    uint32_t delay_slots;
+    uint32_t delay_filled;
+} cache_header_t;
+
+// followed by the name
+typedef struct cache_symbol {
+    uint32_t namelen;
+    uint32_t sector;
+    uint32_t address;
+    uint8_t defined;
+    uint8_t global;
+    uint16_t pad;
+} cache_symbol_t;
+
+// followed by the symbol name, if any
+typedef struct cache_relocation {
+    uint32_t kind;
+    uint32_t sector;
+    uint32_t offset;
+    uint32_t line;
+    uint32_t value;
+    uint32_t addend;
+    uint32_t namelen;
+} cache_relocation_t;
+
+gchar* cache_default_dir(void) {
+    return g_build_filename(g_get_user_cache_dir(), "mips-as", NULL);
+}
+
+static gchar* cache_path(const assembler_t* as, const char* dir) {
+    GChecksum* checksum = g_checksum_new(G_CHECKSUM_SHA256);
+    const char* version = ASM_VERSION;
+    uint32_t options[] = { CACHE_FORMAT, as->relocatable, as->big_endian, as->optimize };
+    g_checksum_update(checksum, (const guchar*) version, (gssize) strlen(version) + 1);
+    g_checksum_update(checksum, (const guchar*) options, sizeof(options));
+    g_checksum_update(checksum, (const guchar*) as->src, (gssize) as->len);
+    gchar* path = g_build_filename(dir, g_checksum_get_string(checksum), NULL);
+    g_checksum_free(checksum);
+    return path;
+}
+
+// Bounds checked reads from a cache file, a truncated or corrupt entry is a
+// miss and not an error
+typedef struct reader {
+    const uint8_t* data;
+    size_t len;
+    size_t position;
+    bool failed;
+} reader_t;
+
+static const uint8_t* read_bytes(reader_t* reader, size_t len) {
+    if (reader->failed || reader->len - reader->position < len) {
+        reader->failed = true;
+        return NULL;
+    }
+    const uint8_t* bytes = reader->data + reader->position;
+    reader->position += len;
+    return bytes;
+}
+
+static bool read_into(reader_t* reader, void* out, size_t len) {
+    const uint8_t* bytes = read_bytes(reader, len);
+    if (bytes != NULL) {
+        memcpy(out, bytes, len);
+    }
+    return bytes != NULL;
+}
+
+static atom_t read_atom(reader_t* reader, uint32_t len) {
+    const uint8_t* name = read_bytes(reader, len);
+    return name != NULL && len > 0 ? intern((const char*) name, len) : ATOM_NONE;
+}
+
+static void read_section(reader_t* reader, buffer_t* buff, uint32_t size, uint32_t align) {
+    const uint8_t* bytes = read_bytes(reader, size);
+    if (bytes != NULL) {
+        buffer_push(buff, bytes, size);
+        buff->align = align;
+    }
+}
+
+// Alignments are used as a modulus and must be what a buffer could have
+static bool valid_align(uint32_t align) {
+    return align != 0 && align <= BUFFER_MAX_ALIGN && (align & (align - 1)) == 0;
+}
+
+static bool valid_sector(uint32_t sector) {
+    return sector == SECTOR_TEXT || sector == SECTOR_DATA;
+}
+
+// Whether a relocation patches a word within its section
+static bool valid_relocation(const assembler_t* as, const cache_relocation_t* entry) {
+    if (entry->kind > FIXUP_WORD32 || !valid_sector(entry->sector)) {
+        return false;
+    }
+    uint32_t size = entry->sector == SECTOR_TEXT ? as->textbuff.size : as->databuff.size;
+    return size >= 4 && entry->offset <= size - 4;
+}
+
+// The key covers the source only, output that depends on included files is
+// never cached
+static bool cacheable(const assembler_t* as) {
+    return !pp_mentions(as->src, as->len, "include");
+}
+
+bool cache_load(assembler_t* as, const char* dir) {
+    if (!cacheable(as)) {
+        return false;
+    }
+    gchar* path = cache_path(as, dir);
+    GMappedFile* file = g_mapped_file_new(path, FALSE, NULL);
+    g_free(path);
+    if (file == NULL) {
+        return false;
+    }
+
+    reader_t reader = {
+        (const uint8_t*) g_mapped_file_get_contents(file), g_mapped_file_get_length(file), 0, false
+    };
+    cache_header_t header;
+    bool valid = read_into(&reader, &header, sizeof(header))
+        && memcmp(header.magic, cache_magic, sizeof(cache_magic)) == 0
+        && header.format == CACHE_FORMAT && valid_align(header.textalign) && valid_align(header.dataalign);
+
+    if (valid) {
+        read_section(&reader, &as->textbuff, header.textsize, header.textalign);
+        read_section(&reader, &as->databuff, header.datasize, header.dataalign);
+
+        for (uint32_t i = 0; i < header.symbols && !reader.failed; i++) {
+            cache_symbol_t entry;
+            if (!read_into(&reader, &entry, sizeof(entry))) {
+                break;
+            }
+            atom_t name = read_atom(&reader, entry.namelen);
+            if (name == ATOM_NONE || !valid_sector(entry.sector)) {
+                reader.failed = true;
+                break;
+            }
+            symbol_t* sym = symtab_get(&as->symbols, name);
+            sym->defined = entry.defined;
+            sym->global = entry.global;
+            sym->sector = entry.sector;
+            sym->address = entry.address;
+        }
+
+        for (uint32_t i = 0; i < header.relocations && !reader.failed; i++) {
+            cache_relocation_t entry;
+            if (!read_into(&reader, &entry, sizeof(entry))) {
+                break;
+            }
+            reference_t rel = { (fixup_kind_t) entry.kind, entry.sector, entry.offset, entry.line, ATOM_NONE,
+                                entry.value, entry.addend, false };
+            rel.symbol = read_atom(&reader, entry.namelen);
+            // without a symbol, the value is the section the relocation refers to
+            if (!valid_relocation(as, &entry)
+                || (rel.symbol == ATOM_NONE && entry.value != SECTOR_ABSOLUTE && !valid_sector(entry.value))) {
+                reader.failed = true;
+                break;
+            }
+            g_array_append_val(as->relocations, rel);
+        }
+        valid = !reader.failed;
+        as->delay_slots = header.delay_slots;
+        as->delay_filled = header.delay_filled;
+    }
+
+    g_mapped_file_unref(file);
+    if (!valid) {
+        // start over from a clean state, the caller assembles as usual
+        assembler_reset(as, as->src, as->len);
+    }
+    return valid;
+}
+
+void cache_store(const assembler_t* as, const char* dir) {
+    if (!cacheable(as) || g_mkdir_with_parents(dir, 0755) != 0) {
+        return;
+    }
+
+    cache_header_t header = {
+        { 0 }, CACHE_FORMAT,
+        as->textbuff.size, as->textbuff.align, as->databuff.size, as->databuff.align,
+        g_hash_table_size(as->symbols.symbols), as->relocations->len, as->delay_slots, as->delay_filled,
+    };
+    memcpy(header.magic, cache_magic, sizeof(cache_magic));
+    GString* out = g_string_sized_new(sizeof(header) + as->textbuff.size + as->databuff.size);
+    g_string_append_len(out, (const gchar*) &header, sizeof(header));
+    g_string_append_len(out, (const gchar*) as->textbuff.data, as->textbuff.size);
+    g_string_append_len(out, (const gchar*) as->databuff.data, as->databuff.size);
+
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, as->symbols.symbols);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        const symbol_t* sym = value;
+        cache_symbol_t entry = { atom_len(sym->name), sym->sector, sym->address, sym->defined, sym->global, 0 };
+        g_string_append_len(out, (const gchar*) &entry, sizeof(entry));
+        g_string_append_len(out, atom_str(sym->name), entry.namelen);
+    }
+
+    for (guint i = 0; i < as->relocations->len; i++) {
+        const reference_t* rel = &g_array_index(as->relocations, reference_t, i);
+        uint32_t namelen = rel->symbol != ATOM_NONE ? atom_len(rel->symbol) : 0;
+        cache_relocation_t entry = { rel->kind, rel->sector, rel->offset, rel->line, rel->value, rel->addend,
+                                     namelen };
+        g_string_append_len(out, (const gchar*) &entry, sizeof(entry));
+        if (namelen > 0) {
+            g_string_append_len(out, atom_str(rel->symbol), namelen);
+        }
+    }
+
+    // written to a temporary file and renamed, concurrent builds never see
+    // half an entry
+    gchar* path = cache_path(as, dir);
+    g_file_set_contents(path, out->str, (gssize) out->len, NULL);
+    g_free(path);
+    g_string_free(out, TRUE);
+}
@@ -0,0 +1,20 @@
+#ifndef ASM_CACHE_H
+#define ASM_CACHE_H
+
+#include "assembler.h"
+
+// On-disk cache of assembled output, keyed by a hash of the source, the
+// assembler version and the options that change the output. `as` must be
+// configured but not yet run.
+
+// Returns the default cache directory, to be freed with g_free
+gchar* cache_default_dir(void);
+
+// Fills `as` with the cached output for its source and returns true, or
+// returns false if there is none
+bool cache_load(assembler_t* as, const char* dir);
+
+// Saves the output of a finished run, failures are silently ignored
+void cache_store(const assembler_t* as, const char* dir);
+
+#endif //ASM_CACHE_H
@@ -0,0 +1,87 @@
+#include "diag.h"
+
+#include <string.h>
+
+void diag_init(diagnostics_t* diags) {
+    diags->count = 0;
+}
+
+// The entry for the next error, NULL once the first DIAG_CAPACITY are kept
+static diagnostic_t* diag_next(diagnostics_t* diags, uint32_t line, uint32_t column, uint32_t offset,
+                               uint32_t length) {
+    if (diags->count++ >= DIAG_CAPACITY) {
+        return NULL;
+    }
+    diagnostic_t* entry = &diags->entries[diags->count - 1];
+    entry->line = line;
+    entry->column = column;
+    entry->offset = offset;
+    entry->length = length;
+    return entry;
+}
+
+void diag_vreport(diagnostics_t* diags, uint32_t line, uint32_t column, uint32_t offset, uint32_t length,
+                  const char* format, va_list args) {
+    if (diags == NULL) {
+        char message[DIAG_MESSAGE_SIZE];
+        g_vsnprintf(message, sizeof(message), format, args);
+        fatal(line, column, "%s", message);
+    }
+    diagnostic_t* entry = diag_next(diags, line, column, offset, length);
+    if (entry != NULL) {
+        g_vsnprintf(entry->message, sizeof(entry->message), format, args);
+    }
+}
+
+void diag_report(diagnostics_t* diags, uint32_t line, uint32_t column, uint32_t offset, uint32_t length,
+                 const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    diag_vreport(diags, line, column, offset, length, format, args);
+    va_end(args);
+}
+
+void diag_append(diagnostics_t* into, const diagnostics_t* from) {
+    uint32_t retained = diag_retained(from);
+    for (uint32_t i = 0; i < retained; i++) {
+        const diagnostic_t* entry = &from->entries[i];
+        diagnostic_t* copy = diag_next(into, entry->line, entry->column, entry->offset, entry->length);
+        if (copy != NULL) {
+            memcpy(copy->message, entry->message, sizeof(copy->message));
+        }
+    }
+    // those `from` did not keep still count
+    into->count += from->count - retained;
+}
+
+uint32_t diag_sorted(const diagnostics_t* diags, const diagnostic_t* sorted[DIAG_CAPACITY]) {
+    uint32_t retained = diag_retained(diags);
+    // insertion sort, stable, so errors on one line stay in the order found
+    for (uint32_t i = 0; i < retained; i++) {
+        const diagnostic_t* entry = &diags->entries[i];
+        uint32_t j = i;
+        while (j > 0 && (sorted[j - 1]->line > entry->line
+                         || (sorted[j - 1]->line == entry->line && sorted[j - 1]->column > entry->column))) {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = entry;
+    }
+    return retained;
+}
+
+void diag_print(GString* out, const char* prefix, const diagnostics_t* diags) {
+    const diagnostic_t* sorted[DIAG_CAPACITY];
+    uint32_t retained = diag_sorted(diags, sorted);
+    for (uint32_t i = 0; i < retained; i++) {
+        g_string_append_printf(out, "%s%s", prefix, sorted[i]->message);
+        size_t len = strlen(sorted[i]->message);
+        if (len == 0 || sorted[i]->message[len - 1] != '\n') {
+            g_string_append_c(out, '\n');
+        }
+    }
+    if (diags->count > retained) {
+        g_string_append_printf(out, "%s%" G_GUINT64_FORMAT " more errors not shown\n", prefix,
+                               diags->count - retained);
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef ASM_DIAG_H
+#define ASM_DIAG_H
+
+#include <mips-as/prelude.h>
+
+#include <stdarg.h>
+
+#define DIAG_CAPACITY 64
+#define DIAG_MESSAGE_SIZE 192
+
+typedef struct diagnostic {
+    // 1-based, column 0 where not known
+    uint32_t line;
+    uint32_t column;
+    // source bytes the error is about, length 0 where not known
+    uint32_t offset;
+    uint32_t length;
+    // as printed, cut short if longer
+    char message[DIAG_MESSAGE_SIZE];
+} diagnostic_t;
+
+// Errors collected during a run, so that one run reports all of them.
+// Reporting never allocates: the first DIAG_CAPACITY errors found are kept,
+// as later ones often follow from them, and `count` counts all of them.
+typedef struct diagnostics {
+    diagnostic_t entries[DIAG_CAPACITY];
+    uint64_t count;
+} diagnostics_t;
+
+void diag_init(diagnostics_t* diags);
+
+// Records an error, or reports it through fatal() if `diags` is NULL
+void diag_report(diagnostics_t* diags, uint32_t line, uint32_t column, uint32_t offset, uint32_t length,
+                 const char* format, ...) G_GNUC_PRINTF(6, 7);
+void diag_vreport(diagnostics_t* diags, uint32_t line, uint32_t column, uint32_t offset, uint32_t length,
+                  const char* format, va_list args) G_GNUC_PRINTF(6, 0);
+
+// Adds the errors of `from`, which come after those already in `into`
+void diag_append(diagnostics_t* into, const diagnostics_t* from);
+
+// Number of entries kept
+static inline uint32_t diag_retained(const diagnostics_t* diags) {
+    return (uint32_t) MIN(diags->count, DIAG_CAPACITY);
+}
+
+// Fills `sorted` with the kept entries in source order
+uint32_t diag_sorted(const diagnostics_t* diags, const diagnostic_t* sorted[DIAG_CAPACITY]);
+
+// Appends the kept entries in source order, and how many were dropped
+void diag_print(GString* out, const char* prefix, const diagnostics_t* diags);
+
+#endif //ASM_DIAG_H
@@ -0,0 +1,354 @@
+#include "elf.h"
+
+#include <elf.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+enum {
+    SEC_NULL,
+    SEC_TEXT,
+    SEC_DATA,
+    SEC_REL_TEXT,
+    SEC_REL_DATA,
+    SEC_SYMTAB,
+    SEC_STRTAB,
+    SEC_SHSTRTAB,
+    SEC_COUNT,
+};
+
+static const char shstrtab[] = "\0.text\0.data\0.rel.text\0.rel.data\0.symtab\0.strtab\0.shstrtab";
+static const uint32_t shnames[SEC_COUNT] = { 0, 1, 7, 13, 23, 33, 41, 49 };
+
+// symbols 1 and 2 stand for the start of .text and .data
+#define SYM_SECTIONS 3
+
+// EF_MIPS_ABI_O32, missing from some elf.h
+#define ELF_MIPS_ABI_O32 0x00001000
+
+#define ELF_MAX_IOV 24
+
+static const uint8_t zeros[BUFFER_MAX_ALIGN];
+
+// Pieces of the file in order. Nothing is copied, each piece points at data
+// that lives until the file is written.
+typedef struct elf {
+    bool big_endian;
+    struct iovec iov[ELF_MAX_IOV];
+    uint32_t iovcnt;
+    uint32_t offset;
+} elf_t;
+
+static inline Elf32_Half elf16(const elf_t* elf, uint32_t value) {
+    return elf->big_endian ? GUINT16_TO_BE((uint16_t) value) : GUINT16_TO_LE((uint16_t) value);
+}
+
+static inline Elf32_Word elf32(const elf_t* elf, uint32_t value) {
+    return elf->big_endian ? GUINT32_TO_BE(value) : GUINT32_TO_LE(value);
+}
+
+// Returns the file offset of the piece
+static uint32_t elf_queue(elf_t* elf, const void* data, uint32_t len) {
+    uint32_t offset = elf->offset;
+    if (len > 0) {
+        g_assert(elf->iovcnt < ELF_MAX_IOV);
+        elf->iov[elf->iovcnt].iov_base = (void*) data;
+        elf->iov[elf->iovcnt].iov_len = len;
+        elf->iovcnt++;
+        elf->offset += len;
+    }
+    return offset;
+}
+
+static void elf_pad(elf_t* elf, uint32_t align) {
+    uint32_t pad = (align - elf->offset % align) % align;
+    elf_queue(elf, zeros, pad);
+}
+
+static void elf_flush(elf_t* elf, int fd, const char* path) {
+    struct iovec* iov = elf->iov;
+    int count = (int) elf->iovcnt;
+    while (count > 0) {
+        ssize_t written = writev(fd, iov, count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            FATAL("%s: %s\n", path, g_strerror(errno))
+        }
+        // skip what went out, a short write may stop inside a piece
+        while (count > 0 && (size_t) written >= iov->iov_len) {
+            written -= (ssize_t) iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (uint8_t*) iov->iov_base + written;
+            iov->iov_len -= (size_t) written;
+        }
+    }
+}
+
+// Locals first, as ELF requires, then in address order so the output does
+// not depend on hash table order
+static gint compare_symbols(gconstpointer a, gconstpointer b) {
+    const symbol_t* x = *(symbol_t* const*) a;
+    const symbol_t* y = *(symbol_t* const*) b;
+    bool xlocal = x->defined && !x->global, ylocal = y->defined && !y->global;
+    if (xlocal != ylocal) {
+        return xlocal ? -1 : 1;
+    }
+    if (x->defined != y->defined) {
+        return x->defined ? -1 : 1;
+    }
+    if (x->defined && x->sector != y->sector) {
+        return x->sector < y->sector ? -1 : 1;
+    }
+    if (x->defined && x->address != y->address) {
+        return x->address < y->address ? -1 : 1;
+    }
+    return strcmp(atom_str(x->name), atom_str(y->name));
+}
+
+// Orders by what a relocation refers to: its section, symbol (or section for
+// an unnamed one) and addend
+static gint compare_targets(const reference_t* x, const reference_t* y) {
+    if (x->sector != y->sector) {
+        return x->sector < y->sector ? -1 : 1;
+    }
+    if (x->symbol != y->symbol) {
+        return x->symbol < y->symbol ? -1 : 1;
+    }
+    if (x->value != y->value) {
+        return x->value < y->value ? -1 : 1;
+    }
+    return x->addend < y->addend ? -1 : x->addend > y->addend;
+}
+
+static gint compare_lo16(gconstpointer a, gconstpointer b) {
+    const reference_t* x = a;
+    const reference_t* y = b;
+    gint order = compare_targets(x, y);
+    return order != 0 ? order : x->offset < y->offset ? -1 : x->offset > y->offset;
+}
+
+// The LO16 of `los` (sorted by compare_lo16) a HI16 pairs with: the first one
+// after it with the same target, or failing that the last one before it
+static const reference_t* pair_lo16(const GArray* los, const reference_t* hi) {
+    guint low = 0, high = los->len;
+    while (low < high) {
+        guint mid = low + (high - low) / 2;
+        if (compare_lo16(&g_array_index(los, reference_t, mid), hi) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (low < los->len && compare_targets(&g_array_index(los, reference_t, low), hi) == 0) {
+        return &g_array_index(los, reference_t, low);
+    }
+    if (low > 0 && compare_targets(&g_array_index(los, reference_t, low - 1), hi) == 0) {
+        return &g_array_index(los, reference_t, low - 1);
+    }
+    return NULL;
+}
+
+// A relocation with the offset it is listed at, that of its LO16 for a HI16
+typedef struct sort_entry {
+    reference_t rel;
+    uint32_t position;
+} sort_entry_t;
+
+static gint compare_entries(gconstpointer a, gconstpointer b) {
+    const sort_entry_t* x = a;
+    const sort_entry_t* y = b;
+    if (x->rel.sector != y->rel.sector) {
+        return x->rel.sector < y->rel.sector ? -1 : 1;
+    }
+    if (x->position != y->position) {
+        return x->position < y->position ? -1 : 1;
+    }
+    // a HI16 goes right before the LO16 it was moved to
+    bool xhi = x->rel.kind == FIXUP_HI16, yhi = y->rel.kind == FIXUP_HI16;
+    if (xhi != yhi) {
+        return xhi ? -1 : 1;
+    }
+    return x->rel.offset < y->rel.offset ? -1 : x->rel.offset > y->rel.offset;
+}
+
+void elf_sort_relocations(assembler_t* as) {
+    GArray* rels = as->relocations;
+    GArray* los = g_array_new(FALSE, FALSE, sizeof(reference_t));
+    for (guint i = 0; i < rels->len; i++) {
+        const reference_t* rel = &g_array_index(rels, reference_t, i);
+        if (rel->kind == FIXUP_LO16) {
+            g_array_append_val(los, *rel);
+        }
+    }
+    g_array_sort(los, compare_lo16);
+
+    GArray* entries = g_array_sized_new(FALSE, FALSE, sizeof(sort_entry_t), rels->len);
+    for (guint i = 0; i < rels->len; i++) {
+        sort_entry_t entry = { g_array_index(rels, reference_t, i), g_array_index(rels, reference_t, i).offset };
+        const reference_t* lo = entry.rel.kind == FIXUP_HI16 ? pair_lo16(los, &entry.rel) : NULL;
+        if (lo != NULL) {
+            entry.position = lo->offset;
+        }
+        g_array_append_val(entries, entry);
+    }
+    g_array_sort(entries, compare_entries);
+    for (guint i = 0; i < rels->len; i++) {
+        g_array_index(rels, reference_t, i) = g_array_index(entries, sort_entry_t, i).rel;
+    }
+    g_array_free(entries, TRUE);
+    g_array_free(los, TRUE);
+}
+
+static const uint32_t relocation_types[] = {
+    [FIXUP_HI16] = R_MIPS_HI16,
+    [FIXUP_LO16] = R_MIPS_LO16,
+    [FIXUP_PC16] = R_MIPS_PC16,
+    [FIXUP_J26] = R_MIPS_26,
+    [FIXUP_WORD32] = R_MIPS_32,
+};
+
+void elf_write(assembler_t* as, const char* path) {
+    elf_t elf = { .big_endian = as->big_endian, .iovcnt = 0, .offset = 0 };
+
+    // Symbol table
+
+    GPtrArray* symbols = g_ptr_array_new();
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, as->symbols.symbols);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        g_ptr_array_add(symbols, value);
+    }
+    g_ptr_array_sort(symbols, compare_symbols);
+
+    GString* strtab = g_string_new(NULL);
+    g_string_append_c(strtab, '\0');
+    GHashTable* indices = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    uint32_t symcount = SYM_SECTIONS + symbols->len, firstglobal = symcount;
+    Elf32_Sym* syms = g_new0(Elf32_Sym, symcount);
+    for (uint32_t s = SEC_TEXT; s <= SEC_DATA; s++) {
+        syms[s].st_info = ELF32_ST_INFO(STB_LOCAL, STT_SECTION);
+        syms[s].st_shndx = elf16(&elf, s);
+    }
+    for (guint i = 0; i < symbols->len; i++) {
+        const symbol_t* sym = g_ptr_array_index(symbols, i);
+        uint32_t index = SYM_SECTIONS + i;
+        // undefined symbols are external
+        bool global = sym->global || !sym->defined;
+        if (global && firstglobal == symcount) {
+            firstglobal = index;
+        }
+
+        Elf32_Sym* out = &syms[index];
+        out->st_name = elf32(&elf, (uint32_t) strtab->len);
+        g_string_append_len(strtab, atom_str(sym->name), atom_len(sym->name) + 1);
+        out->st_value = elf32(&elf, sym->defined ? sym->address : 0);
+        out->st_info = ELF32_ST_INFO(global ? STB_GLOBAL : STB_LOCAL, STT_NOTYPE);
+        out->st_shndx = elf16(&elf, !sym->defined ? SHN_UNDEF : sym->sector == SECTOR_TEXT ? SEC_TEXT : SEC_DATA);
+        g_hash_table_insert(indices, GUINT_TO_POINTER(sym->name), GUINT_TO_POINTER(index));
+    }
+
+    // Relocations, grouped by section
+
+    elf_sort_relocations(as);
+    uint32_t relcount = as->relocations->len, reltext = 0;
+    Elf32_Rel* rels = g_new0(Elf32_Rel, MAX(relcount, 1));
+    for (uint32_t i = 0; i < relcount; i++) {
+        const reference_t* ref = &g_array_index(as->relocations, reference_t, i);
+        uint32_t symbol = STN_UNDEF;
+        if (ref->symbol != ATOM_NONE) {
+            symbol = GPOINTER_TO_UINT(g_hash_table_lookup(indices, GUINT_TO_POINTER(ref->symbol)));
+        } else if (ref->value != SECTOR_ABSOLUTE) {
+            symbol = ref->value == SECTOR_TEXT ? SEC_TEXT : SEC_DATA;
+        }
+        rels[i].r_offset = elf32(&elf, ref->offset);
+        rels[i].r_info = elf32(&elf, ELF32_R_INFO(symbol, relocation_types[ref->kind]));
+        if (ref->sector == SECTOR_TEXT) {
+            reltext++;
+        }
+    }
+
+    // File layout
+
+    Elf32_Ehdr ehdr;
+    Elf32_Shdr shdr[SEC_COUNT];
+    memset(shdr, 0, sizeof(shdr));
+    elf_queue(&elf, &ehdr, sizeof(ehdr));
+
+    struct {
+        const void* data;
+        uint32_t size;
+        uint32_t type;
+        uint32_t align;
+        uint32_t entsize;
+    } sections[SEC_COUNT] = {
+        [SEC_TEXT] = { as->textbuff.data, as->textbuff.size, SHT_PROGBITS, MAX(as->textbuff.align, 4), 0 },
+        [SEC_DATA] = { as->databuff.data, as->databuff.size, SHT_PROGBITS, MAX(as->databuff.align, 4), 0 },
+        [SEC_REL_TEXT] = { rels, reltext * sizeof(Elf32_Rel), SHT_REL, 4, sizeof(Elf32_Rel) },
+        [SEC_REL_DATA] = { rels + reltext, (relcount - reltext) * sizeof(Elf32_Rel), SHT_REL, 4, sizeof(Elf32_Rel) },
+        [SEC_SYMTAB] = { syms, symcount * sizeof(Elf32_Sym), SHT_SYMTAB, 4, sizeof(Elf32_Sym) },
+        [SEC_STRTAB] = { strtab->str, (uint32_t) strtab->len, SHT_STRTAB, 1, 0 },
+        [SEC_SHSTRTAB] = { shstrtab, sizeof(shstrtab), SHT_STRTAB, 1, 0 },
+    };
+
+    for (uint32_t s = SEC_TEXT; s < SEC_COUNT; s++) {
+        elf_pad(&elf, sections[s].align);
+        shdr[s].sh_name = elf32(&elf, shnames[s]);
+        shdr[s].sh_type = elf32(&elf, sections[s].type);
+        shdr[s].sh_offset = elf32(&elf, elf_queue(&elf, sections[s].data, sections[s].size));
+        shdr[s].sh_size = elf32(&elf, sections[s].size);
+        shdr[s].sh_addralign = elf32(&elf, sections[s].align);
+        shdr[s].sh_entsize = elf32(&elf, sections[s].entsize);
+    }
+    shdr[SEC_TEXT].sh_flags = elf32(&elf, SHF_ALLOC | SHF_EXECINSTR);
+    shdr[SEC_DATA].sh_flags = elf32(&elf, SHF_ALLOC | SHF_WRITE);
+    shdr[SEC_REL_TEXT].sh_link = elf32(&elf, SEC_SYMTAB);
+    shdr[SEC_REL_TEXT].sh_info = elf32(&elf, SEC_TEXT);
+    shdr[SEC_REL_DATA].sh_link = elf32(&elf, SEC_SYMTAB);
+    shdr[SEC_REL_DATA].sh_info = elf32(&elf, SEC_DATA);
+    shdr[SEC_SYMTAB].sh_link = elf32(&elf, SEC_STRTAB);
+    shdr[SEC_SYMTAB].sh_info = elf32(&elf, firstglobal);
+
+    elf_pad(&elf, 4);
+    uint32_t shoff = elf_queue(&elf, shdr, sizeof(shdr));
+
+    memset(&ehdr, 0, sizeof(ehdr));
+    memcpy(ehdr.e_ident, ELFMAG, SELFMAG);
+    ehdr.e_ident[EI_CLASS] = ELFCLASS32;
+    ehdr.e_ident[EI_DATA] = as->big_endian ? ELFDATA2MSB : ELFDATA2LSB;
+    ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+    ehdr.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+    ehdr.e_type = elf16(&elf, ET_REL);
+    ehdr.e_machine = elf16(&elf, EM_MIPS);
+    ehdr.e_version = elf32(&elf, EV_CURRENT);
+    ehdr.e_shoff = elf32(&elf, shoff);
+    // delay slots are filled explicitly, nothing may be reordered
+    ehdr.e_flags = elf32(&elf, EF_MIPS_NOREORDER | ELF_MIPS_ABI_O32 | EF_MIPS_ARCH_1);
+    ehdr.e_ehsize = elf16(&elf, sizeof(Elf32_Ehdr));
+    ehdr.e_shentsize = elf16(&elf, sizeof(Elf32_Shdr));
+    ehdr.e_shnum = elf16(&elf, SEC_COUNT);
+    ehdr.e_shstrndx = elf16(&elf, SEC_SHSTRTAB);
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        FATAL("%s: %s\n", path, g_strerror(errno))
+    }
+    elf_flush(&elf, fd, path);
+    if (close(fd) != 0) {
+        FATAL("%s: %s\n", path, g_strerror(errno))
+    }
+
+    g_free(rels);
+    g_free(syms);
+    g_hash_table_destroy(indices);
+    g_string_free(strtab, TRUE);
+    g_ptr_array_free(symbols, TRUE);
+}
@@ -0,0 +1,16 @@
+#ifndef ASM_ELF_H
+#define ASM_ELF_H
+
+#include "assembler.h"
+
+// Writes the output of a relocatable run as an ELF32 MIPS object. The section
+// contents are written straight from the assembler's buffers.
+void elf_write(assembler_t* as, const char* path);
+
+// Puts the relocations in the order the object lists them: by section and
+// offset, except that each HI16 is moved right before the LO16 it pairs with
+// (same target and addend), which linkers look for after it. Sources may
+// write the %lo before the %hi.
+void elf_sort_relocations(assembler_t* as);
+
+#endif //ASM_ELF_H
@@ -0,0 +1,53 @@
+#include <mips-as/prelude.h>
+
+#include <stdlib.h>
+
+typedef struct fatal_state {
+    fatal_handler_t handler;
+    gpointer data;
+    // reused, a handler that longjmps leaves nothing to free
+    GString* message;
+} fatal_state_t;
+
+static void fatal_state_free(gpointer data) {
+    fatal_state_t* state = data;
+    g_string_free(state->message, TRUE);
+    g_free(state);
+}
+
+static GPrivate fatal_state = G_PRIVATE_INIT(fatal_state_free);
+
+static fatal_state_t* fatal_current(void) {
+    fatal_state_t* state = g_private_get(&fatal_state);
+    if (state == NULL) {
+        state = g_new0(fatal_state_t, 1);
+        state->message = g_string_new(NULL);
+        g_private_set(&fatal_state, state);
+    }
+    return state;
+}
+
+void fatal_set_handler(fatal_handler_t handler, gpointer data) {
+    fatal_state_t* state = fatal_current();
+    state->handler = handler;
+    state->data = data;
+}
+
+void fatal_get_handler(fatal_handler_t* handler, gpointer* data) {
+    fatal_state_t* state = fatal_current();
+    *handler = state->handler;
+    *data = state->data;
+}
+
+void fatal(uint32_t line, uint32_t column, const char* format, ...) {
+    fatal_state_t* state = fatal_current();
+    va_list args;
+    va_start(args, format);
+    g_string_vprintf(state->message, format, args);
+    va_end(args);
+    if (state->handler != NULL) {
+        state->handler(line, column, state->message->str, state->data);
+    }
+    g_printerr("%s", state->message->str);
+    exit(-1);
+}
@@ -0,0 +1,187 @@
+#include "intern.h"
+#include "arena.h"
+
+#include <string.h>
+
+#define INTERN_INITIAL_CAPACITY 256
+
+// Atoms are stored in fixed size blocks that never move, so atom_str and
+// atom_data can read them without taking the lock.
+#define ATOM_BLOCK_BITS 12
+#define ATOM_BLOCK_SIZE (1u << ATOM_BLOCK_BITS)
+#define ATOM_MAX_BLOCKS 4096
+
+typedef struct intern_slot {
+    uint32_t hash;
+    atom_t atom;
+} intern_slot_t;
+
+typedef struct atom_entry {
+    const char* str;
+    uint32_t len;
+    gpointer data;
+} atom_entry_t;
+
+// Open addressing table of atoms, the strings themselves live in an arena and
+// are never freed before intern_free. Lookups share a reader lock, only
+// inserting a new atom takes the writer lock.
+static struct {
+    GRWLock lock;
+    gint initialized;
+    arena_t strings;
+    intern_slot_t* slots;
+    uint32_t capacity;
+    uint32_t count;
+    atom_entry_t* blocks[ATOM_MAX_BLOCKS];
+} table;
+
+static inline uint32_t intern_hash(const char* str, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (uint8_t) str[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static inline atom_entry_t* atom_entry(atom_t atom) {
+    return &table.blocks[atom >> ATOM_BLOCK_BITS][atom & (ATOM_BLOCK_SIZE - 1)];
+}
+
+static void intern_init(void) {
+    static gsize once = 0;
+    if (g_once_init_enter(&once)) {
+        g_rw_lock_init(&table.lock);
+        g_once_init_leave(&once, 1);
+    }
+
+    g_rw_lock_writer_lock(&table.lock);
+    if (!table.initialized) {
+        arena_init(&table.strings);
+        table.capacity = INTERN_INITIAL_CAPACITY;
+        table.slots = g_new0(intern_slot_t, table.capacity);
+        // atom 0 is ATOM_NONE
+        table.blocks[0] = g_new0(atom_entry_t, ATOM_BLOCK_SIZE);
+        table.blocks[0][0].str = "";
+        table.count = 1;
+        g_atomic_int_set(&table.initialized, TRUE);
+    }
+    g_rw_lock_writer_unlock(&table.lock);
+}
+
+static void intern_grow(void) {
+    uint32_t capacity = table.capacity * 2;
+    intern_slot_t* slots = g_new0(intern_slot_t, capacity);
+    for (uint32_t i = 0; i < table.capacity; i++) {
+        intern_slot_t slot = table.slots[i];
+        if (slot.atom == ATOM_NONE) {
+            continue;
+        }
+        uint32_t index = slot.hash & (capacity - 1);
+        while (slots[index].atom != ATOM_NONE) {
+            index = (index + 1) & (capacity - 1);
+        }
+        slots[index] = slot;
+    }
+    g_free(table.slots);
+    table.slots = slots;
+    table.capacity = capacity;
+}
+
+// Returns the atom for the string or, if it is missing, the slot to insert it at
+static inline atom_t intern_probe(const char* str, size_t len, uint32_t hash, uint32_t* index) {
+    uint32_t i = hash & (table.capacity - 1);
+    while (table.slots[i].atom != ATOM_NONE) {
+        intern_slot_t slot = table.slots[i];
+        if (slot.hash == hash) {
+            atom_entry_t* entry = atom_entry(slot.atom);
+            if (entry->len == len && memcmp(entry->str, str, len) == 0) {
+                return slot.atom;
+            }
+        }
+        i = (i + 1) & (table.capacity - 1);
+    }
+    *index = i;
+    return ATOM_NONE;
+}
+
+atom_t intern(const char* str, size_t len) {
+    if (G_UNLIKELY(!g_atomic_int_get(&table.initialized))) {
+        intern_init();
+    }
+
+    uint32_t hash = intern_hash(str, len);
+    uint32_t index;
+
+    g_rw_lock_reader_lock(&table.lock);
+    atom_t atom = intern_probe(str, len, hash, &index);
+    g_rw_lock_reader_unlock(&table.lock);
+    if (atom != ATOM_NONE) {
+        return atom;
+    }
+
+    g_rw_lock_writer_lock(&table.lock);
+    // another thread may have added it in between
+    atom = intern_probe(str, len, hash, &index);
+    if (atom == ATOM_NONE) {
+        atom = table.count;
+        if (G_UNLIKELY((atom >> ATOM_BLOCK_BITS) >= ATOM_MAX_BLOCKS)) {
+            FATAL("Too many distinct names\n")
+        }
+        if ((atom & (ATOM_BLOCK_SIZE - 1)) == 0) {
+            table.blocks[atom >> ATOM_BLOCK_BITS] = g_new0(atom_entry_t, ATOM_BLOCK_SIZE);
+        }
+        atom_entry_t* entry = atom_entry(atom);
+        entry->str = arena_strndup(&table.strings, str, len);
+        entry->len = (uint32_t) len;
+        table.count++;
+        table.slots[index].hash = hash;
+        table.slots[index].atom = atom;
+
+        // keep the load factor under 1/2
+        if (table.count * 2 > table.capacity) {
+            intern_grow();
+        }
+    }
+    g_rw_lock_writer_unlock(&table.lock);
+    return atom;
+}
+
+const char* atom_str(atom_t atom) {
+    return atom_entry(atom)->str;
+}
+
+uint32_t atom_len(atom_t atom) {
+    return atom_entry(atom)->len;
+}
+
+gpointer atom_data(atom_t atom) {
+    return g_atomic_pointer_get(&atom_entry(atom)->data);
+}
+
+void atom_set_data(atom_t atom, gpointer data) {
+    g_atomic_pointer_set(&atom_entry(atom)->data, data);
+}
+
+uint32_t intern_count(void) {
+    if (!g_atomic_int_get(&table.initialized)) {
+        return 0;
+    }
+    g_rw_lock_reader_lock(&table.lock);
+    uint32_t count = table.count - 1;
+    g_rw_lock_reader_unlock(&table.lock);
+    return count;
+}
+
+void intern_free(void) {
+    if (!table.initialized) {
+        return;
+    }
+    g_free(table.slots);
+    for (uint32_t i = 0; i < ATOM_MAX_BLOCKS && table.blocks[i] != NULL; i++) {
+        g_free(table.blocks[i]);
+        table.blocks[i] = NULL;
+    }
+    arena_free(&table.strings);
+    table.initialized = FALSE;
+}
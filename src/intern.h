@@ -0,0 +1,28 @@
+#ifndef ASM_INTERN_H
+#define ASM_INTERN_H
+
+#include <mips-as/prelude.h>
+
+// Interned string id. Equal strings always map to the same atom, so names can
+// be compared, hashed and stored as integers. The table is shared by all
+// threads; intern() may be called concurrently.
+typedef uint32_t atom_t;
+
+#define ATOM_NONE 0
+
+atom_t intern(const char* str, size_t len);
+const char* atom_str(atom_t atom);
+uint32_t atom_len(atom_t atom);
+
+// One pointer per atom for memoizing lookups keyed by name (e.g. the opcode
+// of a mnemonic). Reads and writes are atomic, racing writers must store the
+// same value.
+gpointer atom_data(atom_t atom);
+void atom_set_data(atom_t atom, gpointer data);
+
+// Number of atoms handed out so far, atoms are 1..intern_count()
+uint32_t intern_count(void);
+
+void intern_free(void);
+
+#endif //ASM_INTERN_H
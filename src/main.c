@@ -1,65 +1,398 @@
 #include <mips-as/prelude.h>
 
+#include <string.h>
+
 #include "parse/parser.h"
+#include "assembler.h"
+#include "elf.h"
+#include "cache.h"
+#include "stats.h"
+#include "sim.h"
+
+// Expressions are printed in postfix, as they are stored
+void print_expr(GString* out, const statement_t* stmt, expr_ref_t expr) {
+    g_string_append_c(out, '[');
+    for (uint32_t i = 0; i < expr.count; i++) {
+        const expr_op_t* op = &stmt->exprs[expr.first + i];
+        if (i > 0) {
+            g_string_append_c(out, ' ');
+        }
+        if (op->code == EXPR_NUMBER) {
+            g_string_append_printf(out, "%d", op->num);
+        } else if (op->code == EXPR_SYMBOL) {
+            g_string_append(out, atom_str(op->sym));
+        } else {
+            g_string_append(out, op->code == EXPR_NEG ? "neg" : expr_name(op->code));
+        }
+    }
+    g_string_append_c(out, ']');
+}
 
-void print_arg(argument_t* arg) {
+void print_arg(GString* out, const statement_t* stmt, argument_t* arg) {
     switch (arg->type) {
         case ARG_NUMBER:
-            printf("%d", arg->num);
+            g_string_append_printf(out, "%d", arg->num);
             break;
         case ARG_REGISTER:
-            printf("$%d", arg->reg);
+            g_string_append_printf(out, "$%d", arg->reg);
             break;
         case ARG_SYMBOL:
-            printf("%s", arg->sym);
+            g_string_append_printf(out, "%s", atom_str(arg->sym));
             break;
         case ARG_STRING:
-            printf("\"%s\"", arg->str);
+            g_string_append_printf(out, "\"%.*s\"", (int) arg->string.len, arg->string.ptr);
+            break;
+        case ARG_MEMORY:
+            if (arg->mem.expr.count > 0) {
+                print_expr(out, stmt, arg->mem.expr);
+            } else {
+                g_string_append_printf(out, "%d", arg->mem.offset);
+            }
+            g_string_append_printf(out, "($%d)", arg->mem.base);
+            break;
+        case ARG_EXPR:
+            print_expr(out, stmt, arg->expr);
             break;
     }
 }
 
-void print_stmt(gpointer s, gpointer d) {
-    statement_t* stmt = (statement_t*) s;
+void print_stmt(GString* out, const statement_t* stmt) {
     if (stmt->type == STMT_DIRECTIVE) {
-        printf(".%s", stmt->directive.name);
+        g_string_append_printf(out, ".%s", atom_str(stmt->directive.name));
         if (stmt->directive.argument != NULL) {
-            printf(" ");
-            print_arg(stmt->directive.argument);
+            g_string_append_c(out, ' ');
+            print_arg(out, stmt, stmt->directive.argument);
         }
     } else if (stmt->type == STMT_INSTRUCTION) {
-        printf("%s", stmt->instruction.name);
-        for (size_t i = 0; i < stmt->instruction.arguments->len; i++) {
-            printf(" ");
-            print_arg(&g_array_index(stmt->instruction.arguments, argument_t, i));
+        g_string_append_printf(out, "%s", atom_str(stmt->instruction.name));
+        for (uint32_t i = 0; i < stmt->instruction.argc; i++) {
+            g_string_append_c(out, ' ');
+            print_arg(out, stmt, &stmt->instruction.arguments[i]);
         }
     } else if (stmt->type == STMT_LABEL) {
-        printf("%s:", stmt->label.name);
+        g_string_append_printf(out, "%s:", atom_str(stmt->label.name));
     }
-    printf("\n");
+    g_string_append_c(out, '\n');
 }
 
-int main(int argc, const char** argv) {
+void print_section(GString* out, const char* name, buffer_t* buff) {
+    g_string_append_printf(out, ".%s 0x%08x (%d bytes)\n", name, buff->base, buff->size);
+    for (uint32_t i = 0; i < buff->size; i += 4) {
+        uint32_t word = 0;
+        memcpy(&word, buff->data + i, MIN(4, buff->size - i));
+        word = buff->big_endian ? GUINT32_FROM_BE(word) : GUINT32_FROM_LE(word);
+        g_string_append_printf(out, "%08x: %08x\n", buff->base + i, word);
+    }
+}
 
-    if (argc < 2) {
-        g_printerr("Missing file name.");
-        return 1;
+static gboolean print_only = FALSE;
+static gint jobs = 1;
+static gchar* output = NULL;
+static gboolean big_endian = FALSE;
+static gboolean little_endian = FALSE;
+static gboolean use_cache = FALSE;
+static gchar* cache_dir = NULL;
+static gboolean optimize = FALSE;
+static gboolean show_stats = FALSE;
+static gchar* stats_json = NULL;
+static gboolean run = FALSE;
+static gint64 max_steps = 0;
+
+static GOptionEntry entries[] = {
+    { "print", 'p', 0, G_OPTION_ARG_NONE, &print_only, "Print parsed statements instead of assembling", NULL },
+    { "jobs", 'j', 0, G_OPTION_ARG_INT, &jobs, "Use up to N threads, across files or within a large file", "N" },
+    { "output", 'o', 0, G_OPTION_ARG_FILENAME, &output, "Write an ELF relocatable object to FILE", "FILE" },
+    { "EB", 0, 0, G_OPTION_ARG_NONE, &big_endian, "Big-endian output (also -EB)", NULL },
+    { "EL", 0, 0, G_OPTION_ARG_NONE, &little_endian, "Little-endian output, the default (also -EL)", NULL },
+    { "optimize", 'O', 0, G_OPTION_ARG_NONE, &optimize, "Fill branch delay slots and report how many were", NULL },
+    { "cache", 'c', 0, G_OPTION_ARG_NONE, &use_cache, "Reuse the output of earlier runs on the same source", NULL },
+    { "cache-dir", 0, 0, G_OPTION_ARG_FILENAME, &cache_dir, "Cache directory, implies --cache", "DIR" },
+    { "stats", 0, 0, G_OPTION_ARG_NONE, &show_stats, "Print time, throughput and allocations per phase to stderr", NULL },
+    { "stats-json", 0, 0, G_OPTION_ARG_FILENAME, &stats_json, "Write the same counters as JSON to FILE", "FILE" },
+    { "run", 'r', 0, G_OPTION_ARG_NONE, &run, "Run the program and print its output instead of the sections", NULL },
+    { "max-steps", 0, 0, G_OPTION_ARG_INT64, &max_steps, "Stop a --run after N instructions (0, no limit)", "N" },
+    { NULL }
+};
+
+typedef struct job {
+    const char* path;
+    GString* out;
+    stats_t stats;
+    // --run: exit status of the program, and why it stopped if not by exiting.
+    // The message also says why a file could not be read.
+    int32_t exit_code;
+    gchar* message;
+    bool unreadable;
+    // errors in the source, the job has no output if there are any
+    diagnostics_t* diags;
+} job_t;
+
+// Runs the assembled program, its output goes where the sections would
+static void run_program(job_t* job, const assembler_t* as) {
+    sim_t sim;
+    sim_init(&sim, as);
+    sim_status_t status = sim_run(&sim, (uint64_t) MAX(max_steps, 0));
+    g_string_append_len(job->out, sim.out->str, (gssize) sim.out->len);
+    if (status == SIM_EXITED) {
+        job->exit_code = sim.exit_code;
+    } else if (status == SIM_FAULT) {
+        job->exit_code = -1;
+        job->message = g_strdup_printf("%s: %s (pc 0x%08x)\n", job->path, sim.fault, sim.fault_pc);
+    } else {
+        job->exit_code = -1;
+        job->message = g_strdup_printf("%s: stopped after %" G_GUINT64_FORMAT " instructions\n", job->path,
+                                       sim.steps);
     }
+    sim_free(&sim);
+}
 
-    gchar* src;
+// Assembles (or prints) one file into its own output buffer
+static void run_job(job_t* job, uint32_t threads) {
     GError* err = NULL;
+    bool collect = show_stats || stats_json != NULL;
+    uint64_t start = collect ? stats_now() : 0;
+    job->stats.threads = 1;
+
+    // Map the source instead of reading it, tokens point straight into the mapping.
+    // This may run on a worker thread, so a file that cannot be read fails only
+    // its own job.
+    GMappedFile* file = g_mapped_file_new(job->path, FALSE, &err);
+    if (file == NULL) {
+        job->message = g_strdup_printf("%s\n", err->message);
+        job->unreadable = true;
+        job->exit_code = -1;
+        g_error_free(err);
+        return;
+    }
+
+    const gchar* src = g_mapped_file_get_contents(file);
+    gsize len = g_mapped_file_get_length(file);
+    if (len > UINT32_MAX) {
+        job->message = g_strdup_printf("%s: file too large\n", job->path);
+        job->unreadable = true;
+        job->exit_code = -1;
+        g_mapped_file_unref(file);
+        return;
+    }
+
+    GString* out = job->out;
+    if (print_only) {
+        parser_t parser;
+        parser_init(&parser, src, len);
+        parser_set_stats(&parser, collect ? &job->stats : NULL);
+        parser_set_diagnostics(&parser, job->diags);
+        parser_set_path(&parser, job->path);
+        ir_block_t block;
+        ir_init(&block);
+        while (parser_fill(&parser, &block)) {
+            for (uint32_t i = 0; i < block.count; i++) {
+                statement_t stmt;
+                ir_get(&block, i, &stmt);
+                print_stmt(out, &stmt);
+            }
+        }
+        ir_free(&block);
+        parser_free(&parser);
+    } else {
+        assembler_t as = assembler_new(src, len);
+        assembler_set_relocatable(&as, output != NULL);
+        assembler_set_big_endian(&as, big_endian && !little_endian);
+        assembler_set_optimize(&as, optimize);
+        assembler_set_stats(&as, collect ? &job->stats : NULL);
+        assembler_set_diagnostics(&as, job->diags);
+        assembler_set_path(&as, job->path);
+        job->stats.cached = cache_dir != NULL && cache_load(&as, cache_dir);
+        if (!job->stats.cached) {
+            assembler_run_parallel(&as, threads);
+            if (cache_dir != NULL && job->diags->count == 0) {
+                cache_store(&as, cache_dir);
+            }
+        }
+        job->stats.delay_slots = as.delay_slots;
+        job->stats.delay_filled = as.delay_filled;
+        if (job->diags->count > 0) {
+            job->exit_code = -1;
+        } else if (output != NULL) {
+            elf_write(&as, output);
+        } else if (run) {
+            run_program(job, &as);
+        } else {
+            print_section(out, "text", &as.textbuff);
+            print_section(out, "data", &as.databuff);
+        }
+        assembler_free(&as);
+    }
+
+    g_mapped_file_unref(file);
+    if (collect) {
+        job->stats.wall = stats_now() - start;
+    }
+}
+
+static void write_stats(job_t* batch, guint count) {
+    if (show_stats) {
+        GString* out = g_string_new(NULL);
+        for (guint i = 0; i < count; i++) {
+            stats_print(out, batch[i].path, &batch[i].stats);
+        }
+        g_printerr("%s", out->str);
+        g_string_free(out, TRUE);
+    }
+
+    if (stats_json != NULL) {
+        GString* out = g_string_new("{\"files\":[");
+        for (guint i = 0; i < count; i++) {
+            if (i > 0) {
+                g_string_append_c(out, ',');
+            }
+            stats_print_json(out, batch[i].path, &batch[i].stats);
+        }
+        g_string_append(out, "]}\n");
+        GError* err = NULL;
+        if (!g_file_set_contents(stats_json, out->str, (gssize) out->len, &err)) {
+            FATAL("%s\n", err->message)
+        }
+        g_string_free(out, TRUE);
+    }
+}
 
-    if (!g_file_get_contents(argv[1], &src, NULL, &err)) {
+static void pool_worker(gpointer data, gpointer user) {
+    (void) user;
+    run_job((job_t*) data, 1);
+}
+
+// Expands `@file` arguments into the paths listed in the file, one per line
+static void collect_inputs(GPtrArray* paths, int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] != '@') {
+            g_ptr_array_add(paths, g_strdup(argv[i]));
+            continue;
+        }
+
+        gchar* contents;
+        GError* err = NULL;
+        if (!g_file_get_contents(argv[i] + 1, &contents, NULL, &err)) {
+            FATAL("%s\n", err->message)
+        }
+        gchar** lines = g_strsplit(contents, "\n", -1);
+        for (gchar** line = lines; *line != NULL; line++) {
+            g_strstrip(*line);
+            if (**line != '\0') {
+                g_ptr_array_add(paths, g_strdup(*line));
+            }
+        }
+        g_strfreev(lines);
+        g_free(contents);
+    }
+}
+
+int main(int argc, char** argv) {
+
+    // accept the single dash spelling other assemblers use
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-EB") == 0 || strcmp(argv[i], "-EL") == 0) {
+            argv[i] = argv[i][2] == 'B' ? "--EB" : "--EL";
+        }
+    }
+
+    GError* err = NULL;
+    GOptionContext* context = g_option_context_new("FILE... - assemble MIPS source");
+    g_option_context_set_summary(context, "Arguments of the form @LIST name a file listing one input per line.");
+    g_option_context_add_main_entries(context, entries, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &err)) {
         g_printerr("%s\n", err->message);
         g_error_free(err);
+        g_option_context_free(context);
+        return 1;
+    }
+    g_option_context_free(context);
+
+    GPtrArray* paths = g_ptr_array_new_with_free_func(g_free);
+    collect_inputs(paths, argc, argv);
+    if (paths->len == 0) {
+        g_printerr("Missing file name.");
+        g_ptr_array_free(paths, TRUE);
         return 1;
     }
 
-    GQueue* statements = parse(src);
-    g_queue_foreach(statements, print_stmt, NULL);
+    if (output != NULL && paths->len > 1) {
+        g_printerr("-o needs a single input file.\n");
+        g_ptr_array_free(paths, TRUE);
+        return 1;
+    }
+
+    if (run && (output != NULL || print_only)) {
+        g_printerr("--run cannot be combined with -o or -p.\n");
+        g_ptr_array_free(paths, TRUE);
+        return 1;
+    }
+
+    if (use_cache && cache_dir == NULL) {
+        cache_dir = cache_default_dir();
+    }
+
+    uint32_t threads = (uint32_t) MAX(jobs, 1);
+    job_t* batch = g_new0(job_t, paths->len);
+    for (guint i = 0; i < paths->len; i++) {
+        batch[i].path = g_ptr_array_index(paths, i);
+        batch[i].out = g_string_new(NULL);
+        batch[i].diags = g_new(diagnostics_t, 1);
+        diag_init(batch[i].diags);
+    }
+
+    if (paths->len == 1) {
+        // a single file may still be split across threads
+        run_job(&batch[0], threads);
+    } else {
+        // Files are independent, they only share the atom, opcode and
+        // register tables, which are safe to use from any thread.
+        GThreadPool* pool = g_thread_pool_new(pool_worker, NULL, (gint) MIN(threads, paths->len), TRUE, NULL);
+        for (guint i = 0; i < paths->len; i++) {
+            g_thread_pool_push(pool, &batch[i], NULL);
+        }
+        g_thread_pool_free(pool, FALSE, TRUE);
+    }
+
+    // outputs appear in input order no matter which file finished first
+    int32_t exit_code = 0;
+    for (guint i = 0; i < paths->len; i++) {
+        if (paths->len > 1) {
+            printf("%s:\n", batch[i].path);
+        }
+        fwrite(batch[i].out->str, 1, batch[i].out->len, stdout);
+        g_string_free(batch[i].out, TRUE);
+        if (batch[i].diags->count > 0) {
+            // every error of the file, in source order
+            GString* errors = g_string_new(NULL);
+            gchar* prefix = paths->len > 1 ? g_strdup_printf("%s: ", batch[i].path) : g_strdup("");
+            diag_print(errors, prefix, batch[i].diags);
+            g_printerr("%s", errors->str);
+            g_free(prefix);
+            g_string_free(errors, TRUE);
+            batch[i].exit_code = -1;
+        } else if (optimize && !print_only && !batch[i].unreadable) {
+            g_printerr("%s: filled %" G_GUINT64_FORMAT " of %" G_GUINT64_FORMAT " delay slots\n", batch[i].path,
+                       batch[i].stats.delay_filled, batch[i].stats.delay_slots);
+        }
+        if (batch[i].message != NULL) {
+            g_printerr("%s", batch[i].message);
+            g_free(batch[i].message);
+        }
+        // the status of the first file that failed or whose program did not exit with 0
+        if (exit_code == 0) {
+            exit_code = batch[i].exit_code;
+        }
+        g_free(batch[i].diags);
+    }
+    write_stats(batch, paths->len);
 
-    g_queue_free_full(statements, statement_free);
-    g_free(src);
+    g_free(batch);
+    g_ptr_array_free(paths, TRUE);
+    g_free(output);
+    g_free(cache_dir);
+    g_free(stats_json);
+    pp_cache_free();
+    intern_free();
 
-    return 0;
+    return exit_code;
 }
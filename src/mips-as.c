@@ -0,0 +1,168 @@
+#include <mips-as/mips-as.h>
+#include <mips-as/prelude.h>
+
+#include <setjmp.h>
+#include <string.h>
+
+#include "assembler.h"
+#include "elf.h"
+
+struct mips_as_context {
+    assembler_t as;
+    jmp_buf recover;
+    // errors the run recovered from, the result points into it
+    diagnostics_t diags;
+
+    // storage behind the last result
+    GArray* symbols;
+    GArray* relocations;
+    GArray* diagnostics;
+    GStringChunk* strings;
+};
+
+mips_as_context_t* mips_as_context_new(void) {
+    mips_as_context_t* ctx = g_new0(mips_as_context_t, 1);
+    ctx->as = assembler_new(NULL, 0);
+    assembler_set_diagnostics(&ctx->as, &ctx->diags);
+    ctx->symbols = g_array_new(FALSE, FALSE, sizeof(mips_as_symbol_t));
+    ctx->relocations = g_array_new(FALSE, FALSE, sizeof(mips_as_relocation_t));
+    ctx->diagnostics = g_array_new(FALSE, FALSE, sizeof(mips_as_diagnostic_t));
+    ctx->strings = g_string_chunk_new(256);
+    return ctx;
+}
+
+void mips_as_context_free(mips_as_context_t* ctx) {
+    if (ctx == NULL) {
+        return;
+    }
+    assembler_free(&ctx->as);
+    g_array_free(ctx->symbols, TRUE);
+    g_array_free(ctx->relocations, TRUE);
+    g_array_free(ctx->diagnostics, TRUE);
+    g_string_chunk_free(ctx->strings);
+    g_free(ctx);
+}
+
+// Errors the assembler cannot recover from end up here. Records the error
+// and abandons the run, the assembler is reset by the next call.
+static void record_error(uint32_t line, uint32_t column, const char* message, gpointer data) {
+    mips_as_context_t* ctx = data;
+    mips_as_diagnostic_t diagnostic = { line, column, 0, 0, g_string_chunk_insert(ctx->strings, message) };
+    g_array_append_val(ctx->diagnostics, diagnostic);
+    longjmp(ctx->recover, 1);
+}
+
+// Adds the errors of the run ahead of any that abandoned it
+static void collect_diagnostics(mips_as_context_t* ctx, mips_as_result_t* result) {
+    const diagnostic_t* sorted[DIAG_CAPACITY];
+    uint32_t retained = diag_sorted(&ctx->diags, sorted);
+    for (uint32_t i = 0; i < retained; i++) {
+        mips_as_diagnostic_t diagnostic = { sorted[i]->line, sorted[i]->column, sorted[i]->offset, sorted[i]->length,
+                                            sorted[i]->message };
+        g_array_insert_val(ctx->diagnostics, i, diagnostic);
+    }
+    result->diagnostics = (const mips_as_diagnostic_t*) ctx->diagnostics->data;
+    result->ndiagnostics = ctx->diagnostics->len;
+    result->ndropped = (uint32_t) MIN(ctx->diags.count - retained, UINT32_MAX);
+}
+
+static mips_as_section_t section(const buffer_t* buff) {
+    mips_as_section_t section = { buff->data, buff->size, buff->base, buff->align };
+    return section;
+}
+
+static mips_as_section_id_t section_id(uint32_t sector) {
+    switch (sector) {
+        case SECTOR_TEXT:
+            return MIPS_AS_TEXT;
+        case SECTOR_DATA:
+            return MIPS_AS_DATA;
+        default:
+            return MIPS_AS_ABSOLUTE;
+    }
+}
+
+static gint compare_symbols(gconstpointer a, gconstpointer b) {
+    return strcmp(((const mips_as_symbol_t*) a)->name, ((const mips_as_symbol_t*) b)->name);
+}
+
+static void collect_output(mips_as_context_t* ctx, mips_as_result_t* result) {
+    assembler_t* as = &ctx->as;
+    result->text = section(&as->textbuff);
+    result->data = section(&as->databuff);
+    result->delay_slots = as->delay_slots;
+    result->delay_filled = as->delay_filled;
+
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, as->symbols.symbols);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        const symbol_t* sym = value;
+        mips_as_symbol_t entry = { atom_str(sym->name), section_id(sym->sector), sym->address, sym->defined,
+                                   sym->global };
+        g_array_append_val(ctx->symbols, entry);
+    }
+    g_array_sort(ctx->symbols, compare_symbols);
+
+    elf_sort_relocations(as);
+    for (guint i = 0; i < as->relocations->len; i++) {
+        const reference_t* rel = &g_array_index(as->relocations, reference_t, i);
+        bool named = rel->symbol != ATOM_NONE;
+        mips_as_relocation_t entry = {
+            (mips_as_reloc_kind_t) rel->kind, section_id(rel->sector), rel->offset,
+            named ? atom_str(rel->symbol) : NULL, named ? MIPS_AS_ABSOLUTE : section_id(rel->value), rel->line,
+        };
+        g_array_append_val(ctx->relocations, entry);
+    }
+
+    result->symbols = (const mips_as_symbol_t*) ctx->symbols->data;
+    result->nsymbols = ctx->symbols->len;
+    result->relocations = (const mips_as_relocation_t*) ctx->relocations->data;
+    result->nrelocations = ctx->relocations->len;
+}
+
+bool mips_as_assemble(mips_as_context_t* ctx, const char* src, size_t len, const mips_as_options_t* options,
+                      mips_as_result_t* result) {
+    static const mips_as_options_t defaults = { false, false, false };
+    if (options == NULL) {
+        options = &defaults;
+    }
+
+    memset(result, 0, sizeof(*result));
+    g_array_set_size(ctx->symbols, 0);
+    g_array_set_size(ctx->relocations, 0);
+    g_array_set_size(ctx->diagnostics, 0);
+    g_string_chunk_clear(ctx->strings);
+    diag_init(&ctx->diags);
+
+    assembler_t* as = &ctx->as;
+    assembler_reset(as, src, len);
+    assembler_set_relocatable(as, options->relocatable);
+    assembler_set_big_endian(as, options->big_endian);
+    assembler_set_optimize(as, options->optimize);
+
+    bool ok = false;
+    if (len > UINT32_MAX) {
+        mips_as_diagnostic_t diagnostic = { 0, 0, 0, 0, g_string_chunk_insert(ctx->strings, "Source too large\n") };
+        g_array_append_val(ctx->diagnostics, diagnostic);
+    } else {
+        // restored however the run ends, the embedding program may have its own
+        fatal_handler_t outer_handler;
+        gpointer outer_data;
+        fatal_get_handler(&outer_handler, &outer_data);
+        fatal_set_handler(record_error, ctx);
+        if (setjmp(ctx->recover) == 0) {
+            // on the calling thread only, errors on worker threads could
+            // not jump back here
+            assembler_run(as);
+            ok = ctx->diags.count == 0;
+            if (ok) {
+                collect_output(ctx, result);
+            }
+        }
+        fatal_set_handler(outer_handler, outer_data);
+    }
+
+    collect_diagnostics(ctx, result);
+    return ok;
+}
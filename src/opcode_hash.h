@@ -0,0 +1,18 @@
+#ifndef ASM_OPCODE_HASH_H
+#define ASM_OPCODE_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Seeded FNV-1a. Shared by opcodes-gen, which searches for a seed that makes
+// it collision-free over the mnemonic table, and by opcode_lookup at runtime.
+static inline uint32_t opcode_hash(const char* str, size_t len, uint32_t seed) {
+    uint32_t h = 2166136261u ^ seed;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (uint8_t) str[i];
+        h *= 16777619u;
+    }
+    return h ^ (h >> 16);
+}
+
+#endif //ASM_OPCODE_HASH_H
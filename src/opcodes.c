@@ -0,0 +1,42 @@
+#include "opcodes.h"
+#include "opcode_hash.h"
+
+#include <string.h>
+
+static const opcode_t opcode_table[] = {
+#define OP(name, format, layout, opcode, funct, flags) \
+    { #name, sizeof(#name) - 1, format, layout, opcode, funct, flags },
+#include "opcodes.def"
+#undef OP
+};
+
+// Generated by opcodes-gen: OPCODE_HASH_SEED, OPCODE_HASH_BITS and opcode_slots[]
+#include "opcodes_table.h"
+
+const opcode_t* opcode_lookup(const char* name, size_t len) {
+    uint32_t slot = opcode_hash(name, len, OPCODE_HASH_SEED) & ((1u << OPCODE_HASH_BITS) - 1);
+    int16_t index = opcode_slots[slot];
+    if (index < 0) {
+        return NULL;
+    }
+    const opcode_t* op = &opcode_table[index];
+    if (op->len != len || memcmp(op->name, name, len) != 0) {
+        return NULL;
+    }
+    return op;
+}
+
+// Memo stored in the atom for names that are not mnemonics
+static const opcode_t not_an_opcode;
+
+const opcode_t* opcode_from_atom(atom_t atom) {
+    const opcode_t* op = atom_data(atom);
+    if (G_UNLIKELY(op == NULL)) {
+        op = opcode_lookup(atom_str(atom), atom_len(atom));
+        if (op == NULL) {
+            op = &not_an_opcode;
+        }
+        atom_set_data(atom, (gpointer) op);
+    }
+    return op == &not_an_opcode ? NULL : op;
+}
@@ -0,0 +1,61 @@
+#ifndef ASM_OPCODES_H
+#define ASM_OPCODES_H
+
+#include <mips-as/prelude.h>
+#include "intern.h"
+
+typedef enum opformat {
+    FMT_R,
+    FMT_I,
+    FMT_J,
+    FMT_PSEUDO,
+} opformat_t;
+
+// Operand layout as written in the source, in order.
+typedef enum oplayout {
+    LAYOUT_NONE,        // syscall
+    LAYOUT_RD_RS_RT,    // add $rd, $rs, $rt
+    LAYOUT_RD_RT_SA,    // sll $rd, $rt, sa
+    LAYOUT_RD_RT_RS,    // sllv $rd, $rt, $rs
+    LAYOUT_RS_RT,       // mult $rs, $rt
+    LAYOUT_RD,          // mfhi $rd
+    LAYOUT_RS,          // jr $rs
+    LAYOUT_RS_LINK,     // jalr $rs (rd = $ra)
+    LAYOUT_RD_RS,       // move $rd, $rs
+    LAYOUT_RT_RS_IMM,   // addi $rt, $rs, imm
+    LAYOUT_RT_IMM,      // lui $rt, imm
+    LAYOUT_RT_MEM,      // lw $rt, off($rs)
+    LAYOUT_RS_RT_OFF,   // beq $rs, $rt, label
+    LAYOUT_RS_OFF,      // blez $rs, label
+    LAYOUT_TARGET,      // j label
+    LAYOUT_RT_ADDR,     // la $rt, label
+} oplayout_t;
+
+typedef enum pseudo {
+    PSEUDO_NOP,
+    PSEUDO_MOVE,
+    PSEUDO_LI,
+    PSEUDO_LA,
+} pseudo_t;
+
+// Instruction is followed by a branch delay slot
+#define OPF_DELAY  (1 << 0)
+// Immediate is sign-extended by the hardware
+#define OPF_SIGNED (1 << 1)
+
+typedef struct opcode {
+    const char* name;
+    uint8_t len;
+    opformat_t format;
+    oplayout_t layout;
+    uint8_t opcode;
+    uint8_t funct;
+    uint8_t flags;
+} opcode_t;
+
+const opcode_t* opcode_lookup(const char* name, size_t len);
+
+// Same as opcode_lookup, memoized per atom
+const opcode_t* opcode_from_atom(atom_t atom);
+
+#endif //ASM_OPCODES_H
@@ -0,0 +1,114 @@
+#include "ir.h"
+
+#include <string.h>
+
+#define IR_INITIAL_OPERANDS (2 * IR_BLOCK_STATEMENTS)
+#define IR_INITIAL_EXPRS 256
+
+void ir_init(ir_block_t* block) {
+    block->count = 0;
+    block->noperands = 0;
+    block->capacity = IR_INITIAL_OPERANDS;
+    block->allocations = 1;
+    block->operands = g_new(argument_t, block->capacity);
+    block->exprs = NULL;
+    block->nexprs = 0;
+    block->exprs_capacity = 0;
+}
+
+void ir_free(ir_block_t* block) {
+    g_free(block->operands);
+    block->operands = NULL;
+    g_free(block->exprs);
+    block->exprs = NULL;
+}
+
+void ir_clear(ir_block_t* block) {
+    block->count = 0;
+    block->noperands = 0;
+    block->nexprs = 0;
+}
+
+uint32_t ir_add(ir_block_t* block, statement_type_t type, atom_t name, uint32_t line) {
+    uint32_t i = block->count++;
+    block->types[i] = (uint8_t) type;
+    block->argc[i] = 0;
+    block->names[i] = name;
+    block->lines[i] = line;
+    block->first[i] = block->noperands;
+    return i;
+}
+
+void ir_add_operand(ir_block_t* block, const argument_t* arg) {
+    if (block->noperands == block->capacity) {
+        block->capacity *= 2;
+        block->operands = g_renew(argument_t, block->operands, block->capacity);
+        block->allocations++;
+    }
+    block->operands[block->noperands++] = *arg;
+    block->argc[block->count - 1]++;
+}
+
+expr_ref_t ir_add_expr(ir_block_t* block, const expr_op_t* ops, uint32_t count) {
+    if (block->nexprs + count > block->exprs_capacity) {
+        block->exprs_capacity = MAX(MAX(block->exprs_capacity * 2, IR_INITIAL_EXPRS), block->nexprs + count);
+        block->exprs = g_renew(expr_op_t, block->exprs, block->exprs_capacity);
+        block->allocations++;
+    }
+    expr_ref_t ref = { block->nexprs, count };
+    memcpy(block->exprs + block->nexprs, ops, count * sizeof(expr_op_t));
+    block->nexprs += count;
+    return ref;
+}
+
+bool expr_apply(expr_opcode_t code, uint32_t a, uint32_t b, uint32_t* result) {
+    switch (code) {
+        case EXPR_NEG:
+            *result = -a;
+            break;
+        case EXPR_NOT:
+            *result = ~a;
+            break;
+        case EXPR_HI:
+            *result = (a + 0x8000) >> 16;
+            break;
+        case EXPR_LO:
+            *result = a & 0xffff;
+            break;
+        case EXPR_MUL:
+            *result = a * b;
+            break;
+        case EXPR_DIV:
+            if (b == 0) {
+                return false;
+            }
+            // signed, INT32_MIN / -1 wraps around
+            *result = b == UINT32_MAX ? -a : (uint32_t) ((int32_t) a / (int32_t) b);
+            break;
+        case EXPR_ADD:
+            *result = a + b;
+            break;
+        case EXPR_SUB:
+            *result = a - b;
+            break;
+        case EXPR_SHL:
+            *result = b < 32 ? a << b : 0;
+            break;
+        case EXPR_SHR:
+            *result = b < 32 ? a >> b : 0;
+            break;
+        case EXPR_AND:
+            *result = a & b;
+            break;
+        case EXPR_XOR:
+            *result = a ^ b;
+            break;
+        case EXPR_OR:
+            *result = a | b;
+            break;
+        default:
+            *result = a;
+            break;
+    }
+    return true;
+}
@@ -0,0 +1,86 @@
+#ifndef ASM_IR_H
+#define ASM_IR_H
+
+#include <mips-as/prelude.h>
+#include "statement.h"
+
+#define IR_BLOCK_STATEMENTS 1024
+
+// A block of parsed statements in struct-of-arrays form. Statement i has
+// type types[i], name names[i] (directive, mnemonic or label) and its
+// operands are operands[first[i]] to operands[first[i] + argc[i] - 1], all
+// in one pool shared by the block.
+typedef struct ir_block {
+    uint32_t count;
+    uint8_t types[IR_BLOCK_STATEMENTS];
+    uint8_t argc[IR_BLOCK_STATEMENTS];
+    atom_t names[IR_BLOCK_STATEMENTS];
+    uint32_t lines[IR_BLOCK_STATEMENTS];
+    uint32_t first[IR_BLOCK_STATEMENTS];
+
+    argument_t* operands;
+    uint32_t noperands;
+    uint32_t capacity;
+    // operations of ARG_EXPR operands and memory offsets, allocated on
+    // first use
+    expr_op_t* exprs;
+    uint32_t nexprs;
+    uint32_t exprs_capacity;
+    // times the operand and expression pools were allocated, for --stats
+    uint32_t allocations;
+} ir_block_t;
+
+void ir_init(ir_block_t* block);
+void ir_free(ir_block_t* block);
+void ir_clear(ir_block_t* block);
+
+static inline bool ir_full(const ir_block_t* block) {
+    return block->count == IR_BLOCK_STATEMENTS;
+}
+
+// Appends a statement without operands and returns its index
+uint32_t ir_add(ir_block_t* block, statement_type_t type, atom_t name, uint32_t line);
+
+// Drops the statements from index `count` on, with their operands. Their
+// expression operations stay in the pool until the block is cleared.
+static inline void ir_truncate(ir_block_t* block, uint32_t count) {
+    if (count < block->count) {
+        block->noperands = block->first[count];
+        block->count = count;
+    }
+}
+
+// Appends an operand to the last statement
+void ir_add_operand(ir_block_t* block, const argument_t* arg);
+
+// Copies the operations of an expression into the pool
+expr_ref_t ir_add_expr(ir_block_t* block, const expr_op_t* ops, uint32_t count);
+
+// Applies a unary (`b` is ignored) or binary operation to numbers. Returns
+// false on a division by zero.
+bool expr_apply(expr_opcode_t code, uint32_t a, uint32_t b, uint32_t* result);
+
+// Fills in a statement_t view of statement i, its operands point into the
+// block
+static inline void ir_get(const ir_block_t* block, uint32_t i, statement_t* stmt) {
+    argument_t* args = block->operands + block->first[i];
+    stmt->type = (statement_type_t) block->types[i];
+    stmt->line = block->lines[i];
+    stmt->exprs = block->exprs;
+    switch (stmt->type) {
+        case STMT_DIRECTIVE:
+            stmt->directive.name = block->names[i];
+            stmt->directive.argument = block->argc[i] > 0 ? args : NULL;
+            break;
+        case STMT_INSTRUCTION:
+            stmt->instruction.name = block->names[i];
+            stmt->instruction.arguments = args;
+            stmt->instruction.argc = block->argc[i];
+            break;
+        case STMT_LABEL:
+            stmt->label.name = block->names[i];
+            break;
+    }
+}
+
+#endif //ASM_IR_H
@@ -1,227 +1,463 @@
 #include "parser.h"
 
-#include "tokenizer.h"
 #include <assert.h>
 
+// Returns the n-th token ahead without consuming it, reading more tokens from
+// the source as needed.
+static token_t* peek_at(parser_t* parser, uint32_t n) {
+    assert(n < PARSER_LOOKAHEAD);
+    while (parser->count <= n) {
+        uint32_t slot = (parser->head + parser->count) % PARSER_LOOKAHEAD;
+        if (G_LIKELY(parser->stats == NULL)) {
+            pp_next(&parser->pp, &parser->lookahead[slot]);
+        } else {
+            phase_stats_t* tokenize = &parser->stats->phases[PHASE_TOKENIZE];
+            uint64_t start = stats_now();
+            pp_next(&parser->pp, &parser->lookahead[slot]);
+            tokenize->nanos += stats_now() - start;
+            tokenize->items++;
+        }
+        parser->count++;
+    }
+    return &parser->lookahead[(parser->head + n) % PARSER_LOOKAHEAD];
+}
+
 token_t* peek(parser_t* parser) {
-    return (token_t*) g_queue_peek_head(parser->tokens);
+    return peek_at(parser, 0);
 }
 
 static inline tokentype_t peektype(parser_t* parser) {
     return peek(parser)->type;
 }
 
-token_t* consume(parser_t* parser) {
-    return g_queue_pop_head(parser->tokens);
+token_t consume(parser_t* parser) {
+    token_t token = *peek(parser);
+    parser->head = (parser->head + 1) % PARSER_LOOKAHEAD;
+    parser->count--;
+    return token;
 }
 
 void ignore(parser_t* parser) {
-    token_t* token = g_queue_pop_head(parser->tokens);
-    token_free(token);
+    consume(parser);
 }
 
-void ignore_expected(parser_t* parser, tokentype_t type) {
+// Reports `what` followed by the token found instead. A TK_ERROR was
+// reported by the tokenizer already.
+static void unexpected(parser_t* parser, const token_t* token, const char* what) {
+    if (token->type == TK_ERROR) {
+        return;
+    }
+    char found[128];
+    token_describe(token, found, sizeof(found));
+    diag_report(parser->diags, token->line, token->column, token->span.offset, token->span.length, "%s%s at %d:%d\n",
+                what, found, token->line, token->column);
+}
+
+// The read_ functions below return false after reporting an error, the
+// statement is then dropped and parsing resumes on the next line
+bool ignore_expected(parser_t* parser, tokentype_t type) {
     tokentype_t next = peektype(parser);
-    if (next == type) {
-        ignore(parser);
-    } else {
-        g_printerr("Unexpected token ");
-        print_token(peek(parser), stderr);
-        g_printerr(" at %d:%d\n", peek(parser)->line, peek(parser)->column);
-        exit(-1);
+    if (next != type) {
+        unexpected(parser, peek(parser), "Unexpected token ");
+        return false;
     }
+    ignore(parser);
+    return true;
+}
+
+// A statement ends at a newline or at the end of the source
+bool ignore_end_of_line(parser_t* parser) {
+    return peektype(parser) == TK_EOF || ignore_expected(parser, TK_NEWLINE);
 }
 
 bool remain(parser_t* parser) {
-    return !g_queue_is_empty(parser->tokens);
+    return peektype(parser) != TK_EOF;
 }
 
 void skip_newlines(parser_t* parser) {
-    while (remain(parser) && peektype(parser) == TK_NEWLINE) {
+    while (peektype(parser) == TK_NEWLINE) {
         ignore(parser);
     }
 }
 
-static inline bool is_valid_directive_arg(tokentype_t type) {
-    return type == TK_NUMBER || type == TK_STRING || type == TK_SYMBOL;
+// Skips past the next newline, the end of a statement that failed to parse
+static void skip_line(parser_t* parser) {
+    tokentype_t type;
+    while ((type = peektype(parser)) != TK_EOF) {
+        ignore(parser);
+        if (type == TK_NEWLINE) {
+            break;
+        }
+    }
 }
 
-void read_directive(parser_t* parser) {
-    token_t* token = consume(parser);
-    assert(token->type == TK_DIRECTIVE);
-    statement_t* stmt = g_new(statement_t, 1);
-    stmt->type = STMT_DIRECTIVE;
-    stmt->directive.name = g_strdup(token->str);
-
-    if (is_valid_directive_arg(peektype(parser))) {
-        token_t* argtoken = consume(parser);
-        argument_t* arg = g_new(argument_t, 1);
-        if (argtoken->type == TK_NUMBER) {
-            arg->type = ARG_NUMBER;
-            arg->num = argtoken->num;
-        } else if (argtoken->type == TK_STRING) {
-            arg->type = ARG_STRING;
-            arg->str = g_strdup(argtoken->str);
-        } else if (argtoken->type == TK_SYMBOL) {
-            arg->type = ARG_SYMBOL;
-            arg->sym = g_strdup(argtoken->str);
+// Expressions
+
+// Appends an operation to the expression being read. Operations on numbers
+// are folded right away; %hi and %lo are kept, as the assembler fills a 16 bit
+// field differently with them.
+static bool expr_push(parser_t* parser, const token_t* at, expr_opcode_t code, uint32_t value) {
+    expr_op_t* ops = parser->expr;
+    uint32_t n = parser->nexpr;
+    if (code == EXPR_NEG || code == EXPR_NOT) {
+        if (ops[n - 1].code == EXPR_NUMBER) {
+            expr_apply(code, ops[n - 1].num, 0, &ops[n - 1].num);
+            return true;
+        }
+    } else if (code > EXPR_LO && n >= 2 && ops[n - 1].code == EXPR_NUMBER && ops[n - 2].code == EXPR_NUMBER) {
+        // both operands are single numbers then
+        if (!expr_apply(code, ops[n - 2].num, ops[n - 1].num, &ops[n - 2].num)) {
+            diag_report(parser->diags, at->line, at->column, at->span.offset, at->span.length,
+                        "Division by zero at %d:%d\n", at->line, at->column);
+            return false;
         }
-        token_free(argtoken);
-        stmt->directive.argument = arg;
+        parser->nexpr--;
+        return true;
+    }
+    if (n == EXPR_MAX_OPS) {
+        diag_report(parser->diags, at->line, at->column, at->span.offset, at->span.length,
+                    "Expression too long at %d:%d\n", at->line, at->column);
+        return false;
+    }
+    ops[n].code = code;
+    ops[n].num = value;
+    parser->nexpr++;
+    return true;
+}
+
+// Precedence of the binary operator `token` stands for, 0 if it is none
+static uint32_t binary_operator(const token_t* token, expr_opcode_t* code) {
+    if (token->type == TK_NUMBER && token->sign) {
+        *code = EXPR_ADD;
+    } else if (token->type == TK_OPERATOR) {
+        *code = token->op;
     } else {
-        stmt->directive.argument = NULL;
+        return 0;
+    }
+    switch (*code) {
+        case EXPR_MUL:
+        case EXPR_DIV:
+            return 6;
+        case EXPR_ADD:
+        case EXPR_SUB:
+            return 5;
+        case EXPR_SHL:
+        case EXPR_SHR:
+            return 4;
+        case EXPR_AND:
+            return 3;
+        case EXPR_XOR:
+            return 2;
+        case EXPR_OR:
+            return 1;
+        default:
+            return 0;
     }
+}
 
-    ignore_expected(parser, TK_NEWLINE);
-    token_free(token);
+static bool read_binary(parser_t* parser, uint32_t min);
+
+// A number, a symbol, a parenthesized expression or a unary operator applied
+// to one of them
+static bool read_unary(parser_t* parser) {
+    token_t token = *peek(parser);
+    bool operand = token.type == TK_NUMBER || token.type == TK_SYMBOL || token.type == TK_LPAREN
+        || (token.type == TK_OPERATOR && (expr_is_unary(token.op) || token.op == EXPR_ADD || token.op == EXPR_SUB));
+    if (!operand) {
+        // left in place, it may be the newline that ends the statement
+        unexpected(parser, &token, "Expected an expression, found ");
+        return false;
+    }
+    ignore(parser);
+    if (parser->nesting == PARSER_MAX_NESTING) {
+        diag_report(parser->diags, token.line, token.column, token.span.offset, token.span.length,
+                    "Expression nested too deeply at %d:%d\n", token.line, token.column);
+        return false;
+    }
+    parser->nesting++;
+    bool ok;
+    switch (token.type) {
+        case TK_NUMBER:
+            ok = expr_push(parser, &token, EXPR_NUMBER, token.num);
+            break;
+        case TK_SYMBOL:
+            ok = expr_push(parser, &token, EXPR_SYMBOL, token.atom);
+            break;
+        case TK_LPAREN:
+            ok = read_binary(parser, 1) && ignore_expected(parser, TK_RPAREN);
+            break;
+        case TK_OPERATOR:
+            if (token.op == EXPR_HI || token.op == EXPR_LO) {
+                ok = ignore_expected(parser, TK_LPAREN) && read_binary(parser, 1)
+                    && ignore_expected(parser, TK_RPAREN) && expr_push(parser, &token, token.op, 0);
+            } else if (token.op == EXPR_SUB || token.op == EXPR_NOT) {
+                ok = read_unary(parser) && expr_push(parser, &token, token.op == EXPR_SUB ? EXPR_NEG : EXPR_NOT, 0);
+            } else {
+                ok = read_unary(parser);
+            }
+            break;
+        default:
+            ok = false;
+    }
+    parser->nesting--;
+    return ok;
+}
 
-    g_queue_push_tail(parser->statements, stmt);
+// Operands joined by binary operators of precedence `min` and up
+static bool read_binary(parser_t* parser, uint32_t min) {
+    if (!read_unary(parser)) {
+        return false;
+    }
+    for (;;) {
+        token_t token = *peek(parser);
+        expr_opcode_t code;
+        uint32_t precedence = binary_operator(&token, &code);
+        if (precedence == 0 || precedence < min) {
+            return true;
+        }
+        // a signed number is the operator and the right operand at once
+        if (token.type == TK_OPERATOR) {
+            ignore(parser);
+        }
+        if (!read_binary(parser, precedence + 1) || !expr_push(parser, &token, code, 0)) {
+            return false;
+        }
+    }
 }
 
-void read_label(parser_t* parser) {
-    token_t* token = consume(parser);
-    assert(token->type == TK_LABEL);
+static bool read_expression(parser_t* parser) {
+    parser->nexpr = 0;
+    parser->nesting = 0;
+    return read_binary(parser, 1);
+}
 
-    statement_t* stmt = g_new(statement_t, 1);
-    stmt->type = STMT_LABEL;
-    stmt->label.name = g_strdup(token->str);
+// Makes the expression just read `arg`: a plain number or symbol, or the
+// operations in the block's pool
+static void expression_argument(parser_t* parser, ir_block_t* block, argument_t* arg) {
+    const expr_op_t* ops = parser->expr;
+    if (parser->nexpr == 1 && ops[0].code == EXPR_NUMBER) {
+        arg->type = ARG_NUMBER;
+        arg->num = ops[0].num;
+    } else if (parser->nexpr == 1 && ops[0].code == EXPR_SYMBOL) {
+        arg->type = ARG_SYMBOL;
+        arg->sym = ops[0].sym;
+    } else {
+        arg->type = ARG_EXPR;
+        arg->expr = ir_add_expr(block, ops, parser->nexpr);
+    }
+}
 
-    token_free(token);
-    g_queue_push_tail(parser->statements, stmt);
+static inline bool is_expression_start(tokentype_t type) {
+    return type == TK_NUMBER || type == TK_SYMBOL || type == TK_LPAREN || type == TK_OPERATOR;
 }
 
-static inline bool is_valid_instruction_arg(tokentype_t type) {
-    switch (type) {
-        case TK_SYMBOL:
-        case TK_REGISTER:
-        case TK_NUMBER:
-            return true;
-        default:
+bool read_directive(parser_t* parser, ir_block_t* block) {
+    token_t token = consume(parser);
+    assert(token.type == TK_DIRECTIVE);
+    ir_add(block, STMT_DIRECTIVE, token.atom, token.line);
+
+    if (peektype(parser) == TK_STRING) {
+        token_t argtoken = consume(parser);
+        argument_t arg;
+        arg.type = ARG_STRING;
+        arg.string.ptr = argtoken.string.ptr;
+        arg.string.len = argtoken.string.len;
+        ir_add_operand(block, &arg);
+    } else if (is_expression_start(peektype(parser))) {
+        argument_t arg;
+        if (!read_expression(parser)) {
             return false;
+        }
+        expression_argument(parser, block, &arg);
+        ir_add_operand(block, &arg);
     }
+
+    return ignore_end_of_line(parser);
 }
 
+void read_label(parser_t* parser, ir_block_t* block) {
+    token_t token = consume(parser);
+    assert(token.type == TK_LABEL);
+    ir_add(block, STMT_LABEL, token.atom, token.line);
+}
 
-void read_instruction(parser_t* parser) {
-    statement_t* stmt = g_new(statement_t, 1);
-    stmt->type = STMT_INSTRUCTION;
+static inline bool is_valid_instruction_arg(tokentype_t type) {
+    return type == TK_REGISTER || is_expression_start(type);
+}
 
-    token_t* nametoken = consume(parser);
-    assert(nametoken->type == TK_SYMBOL);
-    stmt->instruction.name = g_strdup(nametoken->str);
-    stmt->instruction.arguments = g_array_new(FALSE, FALSE, sizeof(argument_t));
-    g_array_set_clear_func(stmt->instruction.arguments, argument_free_content);
+// Reads the "($reg)" part of a memory operand such as 4($sp), the offset is
+// the expression just read unless `offset` is false
+bool read_memory(parser_t* parser, ir_block_t* block, bool offset, argument_t* arg) {
+    arg->type = ARG_MEMORY;
+    arg->mem.offset = 0;
+    arg->mem.expr.count = 0;
+    if (offset && parser->nexpr == 1 && parser->expr[0].code == EXPR_NUMBER) {
+        arg->mem.offset = parser->expr[0].num;
+    } else if (offset) {
+        arg->mem.expr = ir_add_expr(block, parser->expr, parser->nexpr);
+    }
+
+    if (!ignore_expected(parser, TK_LPAREN)) {
+        return false;
+    }
+    token_t* token = peek(parser);
+    if (token->type != TK_REGISTER) {
+        unexpected(parser, token, "Expected register, found ");
+        return false;
+    }
+    arg->mem.base = token->reg;
+    ignore(parser);
+    return ignore_expected(parser, TK_RPAREN);
+}
+
+bool read_instruction(parser_t* parser, ir_block_t* block) {
+    token_t nametoken = consume(parser);
+    assert(nametoken.type == TK_SYMBOL);
+    ir_add(block, STMT_INSTRUCTION, nametoken.atom, nametoken.line);
+
+    uint32_t argc = 0;
 
     while (is_valid_instruction_arg(peektype(parser))) {
 
-        token_t* token = consume(parser);
+        if (argc == MAX_ARGUMENTS) {
+            diag_report(parser->diags, nametoken.line, nametoken.column, nametoken.span.offset,
+                        nametoken.span.length, "Too many arguments for %s at %d:%d\n", atom_str(nametoken.atom),
+                        nametoken.line, nametoken.column);
+            return false;
+        }
         argument_t arg;
 
-        if (token->type == TK_SYMBOL) {
-            arg.type = ARG_SYMBOL;
-            arg.str = g_strdup(token->str);
-        } else if (token->type == TK_NUMBER) {
-            arg.type = ARG_NUMBER;
-            arg.num = token->num;
-        } else if (token->type == TK_REGISTER) {
+        if (peektype(parser) == TK_REGISTER) {
+            token_t token = consume(parser);
             arg.type = ARG_REGISTER;
-            arg.reg = token->reg;
+            arg.reg = token.reg;
+        } else if (peektype(parser) == TK_LPAREN && peek_at(parser, 1)->type == TK_REGISTER) {
+            if (!read_memory(parser, block, false, &arg)) {
+                return false;
+            }
         } else {
-            FATAL("This should never happen.")
+            if (!read_expression(parser)) {
+                return false;
+            }
+            if (peektype(parser) == TK_LPAREN) {
+                if (!read_memory(parser, block, true, &arg)) {
+                    return false;
+                }
+            } else {
+                expression_argument(parser, block, &arg);
+            }
         }
 
-        g_array_append_val(stmt->instruction.arguments, arg);
-        token_free(token);
+        ir_add_operand(block, &arg);
+        argc++;
 
         if (!remain(parser) || peektype(parser) == TK_NEWLINE) {
             break;
         }
 
-        if (peektype(parser) == TK_COMMA) {
-            ignore(parser);
-        } else {
-            g_printerr("Unexpected token ");
-            print_token(peek(parser), stderr);
-            g_printerr(" at %d:%d\n", peek(parser)->line, peek(parser)->column);
+        // operands are separated by commas, anything else ends the statement
+        // and is reported below
+        if (peektype(parser) != TK_COMMA) {
+            break;
         }
-
+        ignore(parser);
     }
 
-    g_queue_push_tail(parser->statements, stmt);
+    return ignore_end_of_line(parser);
+}
+
+void parser_init(parser_t* parser, const char* src, uint32_t len) {
+    arena_init(&parser->arena);
+    tokenizer_init(&parser->tk, src, len, &parser->arena);
+    pp_init(&parser->pp, &parser->tk);
+    parser->head = 0;
+    parser->count = 0;
+    parser->nexpr = 0;
+    parser->nesting = 0;
+    parser->stats = NULL;
+    parser->diags = NULL;
+}
 
-    if (remain(parser)) {
-        ignore_expected(parser, TK_NEWLINE);
+void parser_free(parser_t* parser) {
+    if (parser->stats != NULL) {
+        parser->stats->phases[PHASE_TOKENIZE].bytes += parser->tk.position;
+        parser->stats->phases[PHASE_TOKENIZE].allocations += parser->arena.allocations;
+        parser->stats->phases[PHASE_PARSE].bytes += parser->tk.position;
     }
+    pp_free(&parser->pp);
+    arena_free(&parser->arena);
+}
 
-    token_free(nametoken);
+void parser_set_line(parser_t* parser, uint32_t line) {
+    parser->tk.line = line;
 }
 
-GQueue* parse(const char* src) {
-    parser_t* parser = g_new(parser_t, 1);
+void parser_set_path(parser_t* parser, const char* path) {
+    pp_set_path(&parser->pp, path);
+}
+
+void parser_set_stats(parser_t* parser, stats_t* stats) {
+    parser->stats = stats;
+}
 
-    GQueue* statements = g_queue_new();
-    parser->tokens = tokenize(src);
-    parser->statements = statements;
+void parser_set_diagnostics(parser_t* parser, diagnostics_t* diags) {
+    parser->diags = diags;
+    parser->tk.diags = diags;
+    parser->pp.diags = diags;
+}
 
-    skip_newlines(parser);
+static bool fill(parser_t* parser, ir_block_t* block) {
+    // The previous block is released in one go. Tokens still waiting in the
+    // lookahead may point into the arenas, so keep them if there are any.
+    if (parser->count == 0) {
+        arena_reset(&parser->arena);
+        pp_release(&parser->pp);
+    }
+    ir_clear(block);
 
-    while (remain(parser)) {
+    while (!ir_full(block)) {
+        skip_newlines(parser);
 
+        uint32_t count = block->count;
+        bool ok = true;
         switch (peektype(parser)) {
+            case TK_EOF:
+                return block->count > 0;
             case TK_DIRECTIVE:
-                read_directive(parser);
+                ok = read_directive(parser, block);
                 break;
             case TK_LABEL:
-                read_label(parser);
+                read_label(parser, block);
                 break;
             case TK_SYMBOL:
-                read_instruction(parser);
+                ok = read_instruction(parser, block);
                 break;
             default:
-                g_printerr("Unexpected token: ");
-                print_token(peek(parser), stderr);
-                g_printerr(" at %d:%d\n", peek(parser)->line, peek(parser)->column);
-                exit(-1);
+                unexpected(parser, peek(parser), "Unexpected token: ");
+                ok = false;
+        }
+        if (!ok) {
+            ir_truncate(block, count);
+            skip_line(parser);
         }
-
-        skip_newlines(parser);
     }
-
-    g_queue_free(parser->tokens);
-    g_free(parser);
-
-    return statements;
+    return true;
 }
 
-void argument_free_content(gpointer a) {
-    argument_t* arg = (argument_t*) a;
-    if (arg->type == ARG_SYMBOL) {
-        g_free((gpointer) arg->sym);
-    } else if (arg->type == ARG_STRING) {
-        g_free((gpointer) arg->str);
+bool parser_fill(parser_t* parser, ir_block_t* block) {
+    if (G_LIKELY(parser->stats == NULL)) {
+        return fill(parser, block);
     }
-}
 
-void argument_free(gpointer a) {
-    if (a != NULL) {
-        argument_free_content(a);
-        g_free(a);
-    }
-}
-void statement_free(gpointer s) {
-    statement_t* stmt = (statement_t*) s;
-    switch (stmt->type) {
-        case STMT_DIRECTIVE:
-            g_free((gpointer) stmt->directive.name);
-            argument_free(stmt->directive.argument);
-            break;
-        case STMT_INSTRUCTION:
-            g_free((gpointer) stmt->instruction.name);
-            g_array_free(stmt->instruction.arguments, TRUE);
-            break;
-        case STMT_LABEL:
-            g_free((gpointer) stmt->label.name);
-            break;
-    }
-    g_free(stmt);
+    // tokens are pulled while parsing, their time is not the parser's
+    phase_stats_t* tokenize = &parser->stats->phases[PHASE_TOKENIZE];
+    phase_stats_t* parse = &parser->stats->phases[PHASE_PARSE];
+    uint64_t start = stats_now();
+    uint64_t tokenizing = tokenize->nanos;
+    uint32_t allocations = block->allocations;
+    bool more = fill(parser, block);
+    parse->nanos += stats_now() - start - (tokenize->nanos - tokenizing);
+    parse->items += block->count;
+    parse->allocations += block->allocations - allocations;
+    return more;
 }
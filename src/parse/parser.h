@@ -2,63 +2,61 @@
 #define ASM_PARSER_H
 
 #include <mips-as/prelude.h>
+#include "tokenizer.h"
+#include "preproc.h"
+#include "statement.h"
+#include "ir.h"
+#include "../stats.h"
+#include "../diag.h"
+
+#define PARSER_LOOKAHEAD 4
+// parentheses and unary operators within one expression
+#define PARSER_MAX_NESTING 64
+
+// Pulls tokens from the tokenizer on demand. Only the tokens in the lookahead
+// ring are alive at any time, so memory use is bounded by the longest line.
+typedef struct parser {
+    tokenizer_t tk;
+    preproc_t pp;
+    token_t lookahead[PARSER_LOOKAHEAD];
+    uint32_t head;
+    uint32_t count;
+
+    // unescaped string literals of the current block
+    arena_t arena;
+
+    // operations of the expression being read, folded as they are added
+    expr_op_t expr[EXPR_MAX_OPS];
+    uint32_t nexpr;
+    uint32_t nesting;
+
+    // tokenize and parse counters are added here if set
+    stats_t* stats;
+
+    // errors are recorded here and the statement skipped if set, otherwise
+    // they are fatal
+    diagnostics_t* diags;
+} parser_t;
 
-typedef enum statement_type {
-    STMT_DIRECTIVE,
-    STMT_INSTRUCTION,
-    STMT_LABEL,
-} statement_type_t;
-
-typedef enum argument_type {
-    ARG_NUMBER,
-    ARG_REGISTER,
-    ARG_SYMBOL,
-    ARG_STRING,
-} argument_type_t;
-
-typedef struct argument {
-    argument_type_t type;
-    union {
-        uint32_t num;
-        uint32_t reg;
-        const char* sym;
-        const char* str;
-    };
-} argument_t;
-
-void argument_free_content(gpointer a);
-void argument_free(gpointer a);
-
-typedef struct statement {
-    statement_type_t type;
-
-    union {
-
-        struct {
-            const char* name;
-            argument_t* argument;
-        } directive;
-
-        struct {
-            const char* name;
-            GArray* arguments;
-        } instruction;
-
-        struct {
-            const char* name;
-        } label;
+void parser_init(parser_t* parser, const char* src, uint32_t len);
+void parser_free(parser_t* parser);
 
-    };
+// Sets the line number of the first line of the source
+void parser_set_line(parser_t* parser, uint32_t line);
 
-} statement_t;
+// Names the file the source was read from, .include resolves against its
+// directory. Without a name it resolves against the working directory.
+void parser_set_path(parser_t* parser, const char* path);
 
-void statement_free(gpointer s);
+// Adds tokenize and parse counters to `stats` from now on
+void parser_set_stats(parser_t* parser, stats_t* stats);
 
-typedef struct parser {
-    GQueue* tokens;
-    GQueue* statements;
-} parser_t;
+// Records syntax errors in `diags` and carries on with the next line
+void parser_set_diagnostics(parser_t* parser, diagnostics_t* diags);
 
-GQueue* parse(const char* src);
+// Parses the next statements into `block`, replacing its contents, and
+// returns false once the source is exhausted. String operands stay valid
+// until the next call.
+bool parser_fill(parser_t* parser, ir_block_t* block);
 
 #endif //ASM_PARSER_H
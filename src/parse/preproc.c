@@ -0,0 +1,704 @@
+#include "preproc.h"
+#include "scan.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <string.h>
+#include <sys/stat.h>
+
+typedef enum pp_directive {
+    PP_INCLUDE,
+    PP_MACRO,
+    PP_ENDM,
+    PP_EQU,
+    PP_NONE,
+} pp_directive_t;
+
+static const char* pp_directive_names[PP_NONE] = {
+    [PP_INCLUDE] = "include",
+    [PP_MACRO] = "macro",
+    [PP_ENDM] = "endm",
+    [PP_EQU] = "equ",
+};
+
+static atom_t pp_directive_atoms[PP_NONE];
+
+static void pp_directives_init(void) {
+    static gsize once = 0;
+    if (g_once_init_enter(&once)) {
+        for (uint32_t i = 0; i < PP_NONE; i++) {
+            pp_directive_atoms[i] = intern(pp_directive_names[i], strlen(pp_directive_names[i]));
+        }
+        g_once_init_leave(&once, 1);
+    }
+}
+
+static inline pp_directive_t pp_directive(atom_t atom) {
+    for (uint32_t i = 0; i < PP_NONE; i++) {
+        if (pp_directive_atoms[i] == atom) {
+            return (pp_directive_t) i;
+        }
+    }
+    return PP_NONE;
+}
+
+typedef struct pp_macro {
+    uint32_t nparams;
+    atom_t params[PP_MAX_PARAMS];
+    // TK_PARAM tokens of the body hold the index of their parameter in `num`
+    const token_t* body;
+    uint32_t count;
+} pp_macro_t;
+
+// Included files
+
+// The tokens of one version of a file, shared by every run that includes it
+typedef struct pp_file {
+    // held by the cache while it is the latest version, and by each run that
+    // included it until the run ends, statements point into it
+    gint refs;
+    // of the file when it was lexed
+    gint64 mtime;
+    gint64 size;
+    // tokens point into the mapping
+    GMappedFile* mapping;
+    gchar* dir;
+    token_t* tokens;
+    uint32_t count;
+    // unescaped string literals
+    arena_t arena;
+    // errors found lexing the file, reported wherever it is included
+    diagnostics_t* diags;
+} pp_file_t;
+
+// The latest version of each file by path. One whose modification time or
+// size changed is lexed again and replaces the entry.
+static struct {
+    GMutex lock;
+    GHashTable* files;
+} pp_cache;
+
+static void pp_file_unref(gpointer data) {
+    pp_file_t* file = data;
+    if (!g_atomic_int_dec_and_test(&file->refs)) {
+        return;
+    }
+    g_mapped_file_unref(file->mapping);
+    g_free(file->dir);
+    g_free(file->tokens);
+    arena_free(&file->arena);
+    g_free(file->diags);
+    g_free(file);
+}
+
+static pp_file_t* pp_file_lex(const char* path, const struct stat* st, gchar** problem) {
+    GError* err = NULL;
+    GMappedFile* mapping = g_mapped_file_new(path, FALSE, &err);
+    if (mapping == NULL) {
+        *problem = g_strdup(err->message);
+        g_error_free(err);
+        return NULL;
+    }
+    gsize len = g_mapped_file_get_length(mapping);
+    if (len > UINT32_MAX) {
+        *problem = g_strdup("file too large");
+        g_mapped_file_unref(mapping);
+        return NULL;
+    }
+
+    pp_file_t* file = g_new0(pp_file_t, 1);
+    file->refs = 1;
+    file->mtime = (gint64) st->st_mtime;
+    file->size = (gint64) st->st_size;
+    file->mapping = mapping;
+    file->dir = g_path_get_dirname(path);
+    arena_init(&file->arena);
+    diagnostics_t* diags = g_new(diagnostics_t, 1);
+    diag_init(diags);
+
+    tokenizer_t tk;
+    tokenizer_init(&tk, g_mapped_file_get_contents(mapping), (uint32_t) len, &file->arena);
+    tk.diags = diags;
+    GArray* tokens = g_array_new(FALSE, FALSE, sizeof(token_t));
+    token_t token;
+    for (tk_next(&tk, &token); token.type != TK_EOF; tk_next(&tk, &token)) {
+        g_array_append_val(tokens, token);
+    }
+
+    file->count = tokens->len;
+    file->tokens = (token_t*) (void*) g_array_free(tokens, FALSE);
+    if (diags->count > 0) {
+        file->diags = diags;
+    } else {
+        g_free(diags);
+    }
+    return file;
+}
+
+static inline bool pp_file_current(const pp_file_t* file, const struct stat* st) {
+    return file != NULL && file->mtime == (gint64) st->st_mtime && file->size == (gint64) st->st_size;
+}
+
+// The tokens of `path` as it is now, lexed on first use. Returns a reference
+// for the caller to release with pp_file_unref.
+static pp_file_t* pp_file(const char* path, gchar** problem) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        *problem = g_strdup(g_strerror(errno));
+        return NULL;
+    }
+
+    g_mutex_lock(&pp_cache.lock);
+    if (pp_cache.files == NULL) {
+        pp_cache.files = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, pp_file_unref);
+    }
+    pp_file_t* file = g_hash_table_lookup(pp_cache.files, path);
+    if (pp_file_current(file, &st)) {
+        g_atomic_int_inc(&file->refs);
+        g_mutex_unlock(&pp_cache.lock);
+        return file;
+    }
+    g_mutex_unlock(&pp_cache.lock);
+
+    // lexed without the lock, a thread that loses the race drops its copy
+    file = pp_file_lex(path, &st, problem);
+    if (file == NULL) {
+        return NULL;
+    }
+    g_mutex_lock(&pp_cache.lock);
+    pp_file_t* other = g_hash_table_lookup(pp_cache.files, path);
+    if (pp_file_current(other, &st)) {
+        pp_file_unref(file);
+        file = other;
+    } else {
+        // the version replaced lives on in the runs that still use it
+        g_hash_table_remove(pp_cache.files, path);
+        g_hash_table_insert(pp_cache.files, g_strdup(path), file);
+    }
+    g_atomic_int_inc(&file->refs);
+    g_mutex_unlock(&pp_cache.lock);
+    return file;
+}
+
+void pp_cache_free(void) {
+    g_mutex_lock(&pp_cache.lock);
+    if (pp_cache.files != NULL) {
+        g_hash_table_destroy(pp_cache.files);
+        pp_cache.files = NULL;
+    }
+    g_mutex_unlock(&pp_cache.lock);
+}
+
+// Token stream
+
+void pp_init(preproc_t* pp, tokenizer_t* tk) {
+    pp_directives_init();
+    pp->tk = tk;
+    pp->depth = 0;
+    for (uint32_t i = 0; i < PP_MAX_DEPTH; i++) {
+        pp->frames[i].expansion = NULL;
+    }
+    for (uint32_t i = 0; i <= PP_MAX_DEPTH; i++) {
+        pp->holding[i] = false;
+    }
+    pp->dir = NULL;
+    pp->line_start = true;
+    pp->macros = NULL;
+    pp->equs = NULL;
+    pp->scratch = NULL;
+    pp->files = NULL;
+    // the arenas are set up on first use, most sources never need them
+    pp->arena.chunks = NULL;
+    pp->arena.allocations = 0;
+    pp->args.chunks = NULL;
+    pp->args.allocations = 0;
+    pp->diags = NULL;
+}
+
+void pp_free(preproc_t* pp) {
+    for (uint32_t i = 0; i < PP_MAX_DEPTH; i++) {
+        if (pp->frames[i].expansion != NULL) {
+            g_array_free(pp->frames[i].expansion, TRUE);
+        }
+    }
+    if (pp->macros != NULL) {
+        g_hash_table_destroy(pp->macros);
+    }
+    if (pp->equs != NULL) {
+        g_hash_table_destroy(pp->equs);
+    }
+    if (pp->scratch != NULL) {
+        g_array_free(pp->scratch, TRUE);
+    }
+    if (pp->files != NULL) {
+        g_ptr_array_free(pp->files, TRUE);
+    }
+    arena_free(&pp->arena);
+    arena_free(&pp->args);
+    g_free(pp->dir);
+}
+
+void pp_set_path(preproc_t* pp, const char* path) {
+    g_free(pp->dir);
+    pp->dir = NULL;
+    if (path != NULL) {
+        // absolute, paths are resolved against it
+        gchar* dir = g_path_get_dirname(path);
+        pp->dir = g_canonicalize_filename(dir, NULL);
+        g_free(dir);
+    }
+}
+
+static arena_t* pp_arena(arena_t* arena) {
+    if (arena->chunks == NULL) {
+        arena_init(arena);
+    }
+    return arena;
+}
+
+static GArray* pp_scratch(preproc_t* pp) {
+    if (pp->scratch == NULL) {
+        pp->scratch = g_array_new(FALSE, FALSE, sizeof(token_t));
+    }
+    g_array_set_size(pp->scratch, 0);
+    return pp->scratch;
+}
+
+// Makes a token outlive the parser's arena and the lookahead, by a copy of
+// its string in `arena`
+static void pp_keep(arena_t* arena, token_t* token) {
+    if (token->type == TK_STRING) {
+        token->string.ptr = arena_strndup(pp_arena(arena), token->string.ptr, token->string.len);
+    }
+}
+
+// Pushes a token back, it is read again once the frames pushed after it are
+// done
+static void pp_hold(preproc_t* pp, const token_t* token) {
+    pp->held[pp->depth] = *token;
+    pp->holding[pp->depth] = true;
+}
+
+// Reads the next token without preprocessing it
+static void pp_raw(preproc_t* pp, token_t* token) {
+    for (;;) {
+        if (pp->holding[pp->depth]) {
+            *token = pp->held[pp->depth];
+            pp->holding[pp->depth] = false;
+            return;
+        }
+        if (pp->depth == 0) {
+            tk_next(pp->tk, token);
+            return;
+        }
+        pp_frame_t* frame = &pp->frames[pp->depth - 1];
+        if (frame->next < frame->count) {
+            *token = frame->tokens[frame->next++];
+            token->span = frame->site.span;
+            token->line = frame->site.line;
+            token->column = frame->site.column;
+            return;
+        }
+        pp->depth--;
+    }
+}
+
+static inline bool pp_is_end(const token_t* token) {
+    return token->type == TK_NEWLINE || token->type == TK_EOF;
+}
+
+static inline const char* pp_dir(const preproc_t* pp) {
+    return pp->depth > 0 ? pp->frames[pp->depth - 1].dir : pp->dir;
+}
+
+static void pp_push(preproc_t* pp, const token_t* site, const token_t* tokens, uint32_t count, const char* dir) {
+    pp_frame_t* frame = &pp->frames[pp->depth];
+    frame->tokens = tokens;
+    frame->count = count;
+    frame->next = 0;
+    frame->dir = dir;
+    frame->site = *site;
+    pp->depth++;
+    pp->holding[pp->depth] = false;
+}
+
+// Reports an error about the directive or invocation at `site` and skips the
+// rest of the line from `at`, the last token read. `token` becomes a
+// TK_ERROR, the parser then skips the statement.
+static G_GNUC_PRINTF(5, 6) void pp_error(preproc_t* pp, token_t* token, const token_t* site, const token_t* at,
+                                         const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    diag_vreport(pp->diags, site->line, site->column, site->span.offset, site->span.length, format, args);
+    va_end(args);
+
+    token_t end = *at;
+    while (!pp_is_end(&end)) {
+        pp_raw(pp, &end);
+    }
+    pp_hold(pp, &end);
+    *token = *site;
+    token->type = TK_ERROR;
+    token->num = 0;
+}
+
+// Whether the line ends after the tokens read so far; the end is held for
+// the parser, anything else is left in `token`
+static bool pp_end_of_line(preproc_t* pp, token_t* token) {
+    pp_raw(pp, token);
+    if (!pp_is_end(token)) {
+        return false;
+    }
+    pp_hold(pp, token);
+    return true;
+}
+
+// The directive handlers return true once the directive is done, or false with
+// `token` turned into a TK_ERROR
+
+static bool pp_include(preproc_t* pp, token_t* token) {
+    token_t site = *token, name;
+    pp_raw(pp, &name);
+    if (name.type != TK_STRING) {
+        pp_error(pp, token, &site, &name, ".include expects a file name (%d:%d)\n", site.line, site.column);
+        return false;
+    }
+    gchar* relative = g_strndup(name.string.ptr, name.string.len);
+    token_t end;
+    if (!pp_end_of_line(pp, &end)) {
+        pp_error(pp, token, &site, &end, ".include expects a file name (%d:%d)\n", site.line, site.column);
+        g_free(relative);
+        return false;
+    }
+    if (pp->depth == PP_MAX_DEPTH) {
+        pp_error(pp, token, &site, &site, "Includes and macros nested too deeply (%d:%d)\n", site.line, site.column);
+        g_free(relative);
+        return false;
+    }
+
+    gchar* path = g_canonicalize_filename(relative, pp_dir(pp));
+    gchar* problem = NULL;
+    pp_file_t* file = pp_file(path, &problem);
+    g_free(path);
+    if (file == NULL) {
+        pp_error(pp, token, &site, &site, "Cannot include %s: %s (%d:%d)\n", relative, problem, site.line,
+                 site.column);
+        g_free(problem);
+        g_free(relative);
+        return false;
+    }
+    if (file->diags != NULL) {
+        const diagnostic_t* sorted[DIAG_CAPACITY];
+        uint32_t count = diag_sorted(file->diags, sorted);
+        for (uint32_t i = 0; i < count; i++) {
+            diag_report(pp->diags, site.line, site.column, site.span.offset, site.span.length, "In %s: %s",
+                        relative, sorted[i]->message);
+        }
+    }
+    g_free(relative);
+    if (pp->files == NULL) {
+        pp->files = g_ptr_array_new_with_free_func(pp_file_unref);
+    }
+    g_ptr_array_add(pp->files, file);
+    pp_push(pp, &site, file->tokens, file->count, file->dir);
+    return true;
+}
+
+static bool pp_define_macro(preproc_t* pp, token_t* token) {
+    token_t site = *token, name, t;
+    pp_raw(pp, &name);
+    if (name.type != TK_SYMBOL) {
+        pp_error(pp, token, &site, &name, ".macro expects a name (%d:%d)\n", site.line, site.column);
+        return false;
+    }
+    pp_macro_t* macro = arena_new(pp_arena(&pp->arena), pp_macro_t, 1);
+    macro->nparams = 0;
+    for (pp_raw(pp, &t); !pp_is_end(&t); pp_raw(pp, &t)) {
+        if (t.type == TK_COMMA && macro->nparams > 0) {
+            continue;
+        }
+        if (t.type != TK_SYMBOL || macro->nparams == PP_MAX_PARAMS) {
+            pp_error(pp, token, &site, &t, "Invalid parameters for macro %s (%d:%d)\n", atom_str(name.atom),
+                     site.line, site.column);
+            return false;
+        }
+        macro->params[macro->nparams++] = t.atom;
+    }
+
+    // the body, up to a line that starts with .endm
+    GArray* body = pp_scratch(pp);
+    bool line_start = true, valid = true;
+    for (;;) {
+        pp_raw(pp, &t);
+        if (t.type == TK_EOF) {
+            pp_error(pp, token, &site, &t, "Missing .endm for macro %s (%d:%d)\n", atom_str(name.atom), site.line,
+                     site.column);
+            return false;
+        }
+        if (line_start && t.type == TK_DIRECTIVE && t.atom == pp_directive_atoms[PP_ENDM]) {
+            break;
+        }
+        line_start = t.type == TK_NEWLINE || t.type == TK_LABEL;
+        if (t.type == TK_PARAM) {
+            uint32_t i = 0;
+            while (i < macro->nparams && macro->params[i] != t.atom) {
+                i++;
+            }
+            if (i == macro->nparams) {
+                diag_report(pp->diags, t.line, t.column, t.span.offset, t.span.length,
+                            "Unknown parameter \\%s in macro %s (%d:%d)\n", atom_str(t.atom), atom_str(name.atom),
+                            t.line, t.column);
+                valid = false;
+            }
+            t.num = i;
+        }
+        pp_keep(&pp->arena, &t);
+        g_array_append_val(body, t);
+    }
+
+    if (pp->macros == NULL) {
+        pp->macros = g_hash_table_new(g_direct_hash, g_direct_equal);
+    }
+    if (g_hash_table_contains(pp->macros, GUINT_TO_POINTER(name.atom))) {
+        diag_report(pp->diags, site.line, site.column, site.span.offset, site.span.length,
+                    "Macro %s already defined (%d:%d)\n", atom_str(name.atom), site.line, site.column);
+        return true;
+    }
+    if (valid) {
+        token_t* tokens = arena_new(pp_arena(&pp->arena), token_t, MAX(body->len, 1));
+        memcpy(tokens, body->data, sizeof(token_t) * body->len);
+        macro->body = tokens;
+        macro->count = body->len;
+        g_hash_table_insert(pp->macros, GUINT_TO_POINTER(name.atom), macro);
+    }
+    return true;
+}
+
+static bool pp_define_equ(preproc_t* pp, token_t* token) {
+    token_t site = *token, name, value;
+    pp_raw(pp, &name);
+    if (name.type != TK_SYMBOL) {
+        pp_error(pp, token, &site, &name, ".equ expects a name and a value (%d:%d)\n", site.line, site.column);
+        return false;
+    }
+    pp_raw(pp, &value);
+    if (value.type == TK_COMMA) {
+        pp_raw(pp, &value);
+    }
+    switch (value.type) {
+        case TK_SYMBOL: {
+            const token_t* known = pp->equs != NULL ? g_hash_table_lookup(pp->equs, GUINT_TO_POINTER(value.atom)) : NULL;
+            if (known != NULL) {
+                value = *known;
+            }
+            break;
+        }
+        case TK_NUMBER:
+        case TK_REGISTER:
+        case TK_STRING:
+            break;
+        default:
+            pp_error(pp, token, &site, &value, ".equ expects a name and a value (%d:%d)\n", site.line, site.column);
+            return false;
+    }
+    pp_keep(&pp->arena, &value);
+    token_t end;
+    if (!pp_end_of_line(pp, &end)) {
+        pp_error(pp, token, &site, &end, ".equ expects a name and a value (%d:%d)\n", site.line, site.column);
+        return false;
+    }
+
+    if (pp->equs == NULL) {
+        pp->equs = g_hash_table_new(g_direct_hash, g_direct_equal);
+    }
+    token_t* stored = arena_new(pp_arena(&pp->arena), token_t, 1);
+    *stored = value;
+    g_hash_table_insert(pp->equs, GUINT_TO_POINTER(name.atom), stored);
+    return true;
+}
+
+// Replaces the invocation at `token` by the macro body, with the arguments
+// in place of the parameters. Missing arguments are empty.
+static bool pp_expand(preproc_t* pp, const pp_macro_t* macro, token_t* token) {
+    token_t site = *token, t;
+    GArray* args = pp_scratch(pp);
+    uint32_t starts[PP_MAX_PARAMS + 1];
+    uint32_t nargs = 0, nesting = 0;
+
+    // arguments are split at commas outside parentheses
+    pp_raw(pp, &t);
+    if (!pp_is_end(&t)) {
+        starts[nargs++] = 0;
+    }
+    for (; !pp_is_end(&t); pp_raw(pp, &t)) {
+        if (t.type == TK_COMMA && nesting == 0) {
+            if (nargs == macro->nparams) {
+                pp_error(pp, token, &site, &t, "Too many arguments for macro %s (%d:%d)\n", atom_str(site.atom),
+                         site.line, site.column);
+                return false;
+            }
+            starts[nargs++] = args->len;
+            continue;
+        }
+        if (t.type == TK_LPAREN) {
+            nesting++;
+        } else if (t.type == TK_RPAREN && nesting > 0) {
+            nesting--;
+        }
+        pp_keep(&pp->args, &t);
+        g_array_append_val(args, t);
+    }
+    pp_hold(pp, &t);
+    if (nargs > macro->nparams) {
+        pp_error(pp, token, &site, &site, "Too many arguments for macro %s (%d:%d)\n", atom_str(site.atom),
+                 site.line, site.column);
+        return false;
+    }
+    while (nargs <= macro->nparams) {
+        starts[nargs++] = args->len;
+    }
+    if (pp->depth == PP_MAX_DEPTH) {
+        pp_error(pp, token, &site, &site, "Includes and macros nested too deeply (%d:%d)\n", site.line,
+                 site.column);
+        return false;
+    }
+
+    pp_frame_t* frame = &pp->frames[pp->depth];
+    if (frame->expansion == NULL) {
+        frame->expansion = g_array_new(FALSE, FALSE, sizeof(token_t));
+    }
+    GArray* expansion = frame->expansion;
+    g_array_set_size(expansion, 0);
+    const token_t* argv = (const token_t*) (void*) args->data;
+    for (uint32_t i = 0; i < macro->count; i++) {
+        const token_t* b = &macro->body[i];
+        if (b->type == TK_PARAM) {
+            g_array_append_vals(expansion, argv + starts[b->num], starts[b->num + 1] - starts[b->num]);
+        } else {
+            g_array_append_vals(expansion, b, 1);
+        }
+    }
+    pp_push(pp, &site, (const token_t*) (void*) expansion->data, expansion->len, pp_dir(pp));
+    return true;
+}
+
+void pp_next(preproc_t* pp, token_t* token) {
+    for (;;) {
+        pp_raw(pp, token);
+        if (token->type == TK_DIRECTIVE) {
+            bool done;
+            switch (pp_directive(token->atom)) {
+                case PP_INCLUDE:
+                    done = pp_include(pp, token);
+                    break;
+                case PP_MACRO:
+                    done = pp_define_macro(pp, token);
+                    break;
+                case PP_EQU:
+                    done = pp_define_equ(pp, token);
+                    break;
+                case PP_ENDM: {
+                    token_t site = *token;
+                    pp_error(pp, token, &site, &site, ".endm outside of a macro (%d:%d)\n", site.line, site.column);
+                    return;
+                }
+                default:
+                    pp->line_start = false;
+                    return;
+            }
+            if (!done) {
+                return;
+            }
+            continue;
+        }
+        if (token->type == TK_SYMBOL) {
+            if (pp->line_start && pp->macros != NULL) {
+                const pp_macro_t* macro = g_hash_table_lookup(pp->macros, GUINT_TO_POINTER(token->atom));
+                if (macro != NULL) {
+                    if (!pp_expand(pp, macro, token)) {
+                        return;
+                    }
+                    continue;
+                }
+            }
+            if (pp->equs != NULL) {
+                const token_t* value = g_hash_table_lookup(pp->equs, GUINT_TO_POINTER(token->atom));
+                if (value != NULL) {
+                    // the value, where the name was. A signed number does
+                    // not add itself to what is before the name.
+                    token_t at = *token;
+                    *token = *value;
+                    token->span = at.span;
+                    token->line = at.line;
+                    token->column = at.column;
+                    if (token->type == TK_NUMBER) {
+                        token->sign = false;
+                    }
+                }
+            }
+        }
+        pp->line_start = token->type == TK_NEWLINE || token->type == TK_LABEL;
+        return;
+    }
+}
+
+void pp_release(preproc_t* pp) {
+    if (pp->args.chunks == NULL) {
+        return;
+    }
+    // frames of includes replay cached tokens, those of expansions arguments.
+    // A frame read to the end stays until the next token is read.
+    for (uint32_t i = 0; i < pp->depth; i++) {
+        const pp_frame_t* frame = &pp->frames[i];
+        if (frame->next < frame->count && frame->expansion != NULL
+            && frame->tokens == (const token_t*) (void*) frame->expansion->data) {
+            return;
+        }
+    }
+    arena_reset(&pp->args);
+}
+
+// Past the end of the statement at `pos`, skipping strings, which may span
+// lines, and comments
+static uint32_t pp_skip_statement(const char* src, uint32_t pos, uint32_t len) {
+    for (;;) {
+        uint32_t end = scan_line_end(src, pos, len);
+        const char* quote = memchr(src + pos, '"', end - pos);
+        const char* comment = memchr(src + pos, ';', end - pos);
+        if (quote == NULL || (comment != NULL && comment < quote)) {
+            return end < len ? end + 1 : len;
+        }
+        pos = (uint32_t) (quote - src) + 1;
+        while (pos < len && src[pos] != '"') {
+            pos += src[pos] == '\\' ? 2 : 1;
+        }
+        if (pos >= len) {
+            return len;
+        }
+        pos++;
+    }
+}
+
+bool pp_mentions(const char* src, size_t len, const char* name) {
+    size_t n = strlen(name);
+    uint32_t srclen = (uint32_t) len;
+    for (uint32_t pos = 0; pos < srclen; pos = pp_skip_statement(src, pos, srclen)) {
+        pos = scan_spaces(src, pos, srclen);
+        // labels may come first
+        while (pos < srclen && (isalpha(src[pos]) || src[pos] == '_')) {
+            uint32_t end = scan_ident(src, pos, srclen);
+            if (end >= srclen || src[end] != ':') {
+                break;
+            }
+            pos = scan_spaces(src, end + 1, srclen);
+        }
+        if (pos < srclen && src[pos] == '.') {
+            uint32_t end = scan_ident(src, pos + 1, srclen);
+            if (end - pos - 1 == n && memcmp(src + pos + 1, name, n) == 0) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
@@ -0,0 +1,79 @@
+#ifndef ASM_PREPROC_H
+#define ASM_PREPROC_H
+
+#include <mips-as/prelude.h>
+#include "tokenizer.h"
+
+// .include files and macro expansions nested in each other
+#define PP_MAX_DEPTH 32
+#define PP_MAX_PARAMS 16
+
+// Tokens replayed in place of an .include or a macro invocation
+typedef struct pp_frame {
+    const token_t* tokens;
+    uint32_t count;
+    uint32_t next;
+    // directory an .include within resolves against
+    const char* dir;
+    // the .include or invocation, every token of the frame is reported there
+    token_t site;
+    // expanded macro body, reused by the next expansion at this depth
+    GArray* expansion;
+} pp_frame_t;
+
+// Sits between the tokenizer and the parser and handles three directives:
+// .include "file" replays the tokens of another file, lexed once per process
+// and file version; .macro name [param, ...] to .endm records tokens that
+// replace the name where it starts a statement, with \param replaced by the
+// arguments; .equ name, value replaces the name by a token from then on.
+typedef struct preproc {
+    tokenizer_t* tk;
+    pp_frame_t frames[PP_MAX_DEPTH];
+    // frames in use, 0 while reading from `tk`
+    uint32_t depth;
+    // A token read ahead at each depth, returned before anything else from
+    // that depth but after any frame pushed since
+    token_t held[PP_MAX_DEPTH + 1];
+    bool holding[PP_MAX_DEPTH + 1];
+    // of the source `tk` reads, NULL for the working directory
+    gchar* dir;
+    bool line_start;
+
+    // created on first use
+    GHashTable* macros;
+    GHashTable* equs;
+    // a reference to each file included, statements may point into them
+    GPtrArray* files;
+    // tokens of the macro body or the arguments being read
+    GArray* scratch;
+    // macro bodies and .equ values
+    arena_t arena;
+    // strings of macro arguments, released by pp_release
+    arena_t args;
+
+    diagnostics_t* diags;
+} preproc_t;
+
+void pp_init(preproc_t* pp, tokenizer_t* tk);
+void pp_free(preproc_t* pp);
+
+// Names the file `tk` reads, .include resolves against its directory
+void pp_set_path(preproc_t* pp, const char* path);
+
+// Reads the next token after preprocessing, like tk_next
+void pp_next(preproc_t* pp, token_t* token);
+
+// Releases the strings of macro arguments if no expansion is left that
+// replays them. Statements read before must not be needed anymore.
+void pp_release(preproc_t* pp);
+
+// Whether a statement of `src` starts with the directive .`name`, after any
+// labels. Comments and strings do not count. Sources without any can skip the
+// preprocessor's state.
+bool pp_mentions(const char* src, size_t len, const char* name);
+
+// Releases the tokens of every file included so far, once the runs that
+// included them are freed
+void pp_cache_free(void);
+
+#endif //ASM_PREPROC_H
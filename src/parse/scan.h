@@ -0,0 +1,158 @@
+#ifndef ASM_SCAN_H
+#define ASM_SCAN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Byte classification kernels for the tokenizer. Each scan returns the first
+// position at or after `pos` (and before `len`) that does not belong to the
+// class, or `len`. Whole blocks are classified with SSE2/AVX2 when the build
+// targets them; the scalar loops handle the tail and other targets.
+
+static inline bool scan_is_ident(char c) {
+    char l = (char) (c | 0x20);
+    return (l >= 'a' && l <= 'z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+// isspace() without '\n', which is a token of its own
+static inline bool scan_is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+#if defined(__AVX2__)
+
+#define SCAN_WIDTH 32
+typedef __m256i scan_vec_t;
+#define scan_load(p) _mm256_loadu_si256((const __m256i*) (p))
+#define scan_set1(c) _mm256_set1_epi8((char) (c))
+#define scan_eq(a, b) _mm256_cmpeq_epi8(a, b)
+#define scan_lt(a, b) _mm256_cmpgt_epi8(b, a)
+#define scan_or(a, b) _mm256_or_si256(a, b)
+#define scan_andnot(a, b) _mm256_andnot_si256(a, b)
+#define scan_add(a, b) _mm256_add_epi8(a, b)
+#define scan_mask(v) ((uint32_t) _mm256_movemask_epi8(v))
+
+#elif defined(__SSE2__)
+
+#define SCAN_WIDTH 16
+typedef __m128i scan_vec_t;
+#define scan_load(p) _mm_loadu_si128((const __m128i*) (p))
+#define scan_set1(c) _mm_set1_epi8((char) (c))
+#define scan_eq(a, b) _mm_cmpeq_epi8(a, b)
+#define scan_lt(a, b) _mm_cmplt_epi8(a, b)
+#define scan_or(a, b) _mm_or_si128(a, b)
+#define scan_andnot(a, b) _mm_andnot_si128(a, b)
+#define scan_add(a, b) _mm_add_epi8(a, b)
+#define scan_mask(v) ((uint32_t) _mm_movemask_epi8(v))
+
+#endif
+
+#ifdef SCAN_WIDTH
+
+// Lanes with lo <= x <= hi. Shifting the range down to start at -128 turns
+// the unsigned range check into a single signed compare.
+static inline scan_vec_t scan_range(scan_vec_t x, uint8_t lo, uint8_t hi) {
+    scan_vec_t shifted = scan_add(x, scan_set1(0x80 - lo));
+    return scan_lt(shifted, scan_set1(0x80 + (hi - lo + 1)));
+}
+
+static inline uint32_t scan_ident_mask(scan_vec_t x) {
+    scan_vec_t alpha = scan_range(scan_or(x, scan_set1(0x20)), 'a', 'z');
+    scan_vec_t digit = scan_range(x, '0', '9');
+    scan_vec_t under = scan_eq(x, scan_set1('_'));
+    return scan_mask(scan_or(scan_or(alpha, digit), under));
+}
+
+static inline uint32_t scan_space_mask(scan_vec_t x) {
+    // \t \v \f \r are 0x09 and 0x0b-0x0d, \n (0x0a) is excluded
+    scan_vec_t ctrl = scan_andnot(scan_eq(x, scan_set1('\n')), scan_range(x, '\t', '\r'));
+    return scan_mask(scan_or(ctrl, scan_eq(x, scan_set1(' '))));
+}
+
+#define SCAN_FULL ((uint32_t) (((uint64_t) 1 << SCAN_WIDTH) - 1))
+
+#endif
+
+static inline uint32_t scan_ident(const char* src, uint32_t pos, uint32_t len) {
+#ifdef SCAN_WIDTH
+    while (pos + SCAN_WIDTH <= len) {
+        uint32_t mask = scan_ident_mask(scan_load(src + pos));
+        if (mask != SCAN_FULL) {
+            return pos + __builtin_ctz(~mask);
+        }
+        pos += SCAN_WIDTH;
+    }
+#endif
+    while (pos < len && scan_is_ident(src[pos])) {
+        pos++;
+    }
+    return pos;
+}
+
+static inline uint32_t scan_spaces(const char* src, uint32_t pos, uint32_t len) {
+    // the common case is a single separating space
+    if (pos < len && !scan_is_space(src[pos])) {
+        return pos;
+    }
+#ifdef SCAN_WIDTH
+    while (pos + SCAN_WIDTH <= len) {
+        uint32_t mask = scan_space_mask(scan_load(src + pos));
+        if (mask != SCAN_FULL) {
+            return pos + __builtin_ctz(~mask);
+        }
+        pos += SCAN_WIDTH;
+    }
+#endif
+    while (pos < len && scan_is_space(src[pos])) {
+        pos++;
+    }
+    return pos;
+}
+
+// Hex digits, eight at a time in a 64-bit word (SWAR). The word holds the
+// characters in memory order, src[pos] in the low byte.
+
+#define SCAN_BYTES(b) (0x0101010101010101ULL * (b))
+
+// Bytes with lo <= x <= hi get their high bit set. Only valid for bytes
+// below 0x80, which the caller checks, so the additions never carry.
+static inline uint64_t scan_range8(uint64_t x, uint8_t lo, uint8_t hi) {
+    uint64_t ge = x + SCAN_BYTES(0x80 - lo);
+    uint64_t le = ~(x + SCAN_BYTES(0x7f - hi));
+    return ge & le & SCAN_BYTES(0x80);
+}
+
+// Number of leading hex digits in the word
+static inline uint32_t scan_hex_count8(uint64_t x) {
+    uint64_t digit = scan_range8(x, '0', '9') | scan_range8(x | SCAN_BYTES(0x20), 'a', 'f');
+    uint64_t invalid = (~digit | x) & SCAN_BYTES(0x80);
+    return invalid == 0 ? 8 : (uint32_t) __builtin_ctzll(invalid) / 8;
+}
+
+// Value of a word of eight hex digits
+static inline uint32_t scan_hex_value8(uint64_t x) {
+    // '0'-'9' are 0x3_, letters have bit 6 set and need 9 added to the low nibble
+    x = (x & SCAN_BYTES(0x0f)) + ((x >> 6) & SCAN_BYTES(0x01)) * 9;
+    // pair up nibbles, bytes and halves, the first character is the most significant
+    x = ((x & 0x0f000f000f000f00ULL) >> 8) | ((x & 0x000f000f000f000fULL) << 4);
+    x = ((x & 0x00ff000000ff0000ULL) >> 16) | ((x & 0x000000ff000000ffULL) << 8);
+    return (uint32_t) (((x & 0x0000ffff00000000ULL) >> 32) | ((x & 0x000000000000ffffULL) << 16));
+}
+
+// Position of the next '\n', libc's memchr is already vectorized
+static inline uint32_t scan_line_end(const char* src, uint32_t pos, uint32_t len) {
+    if (pos >= len) {
+        return len;
+    }
+    const char* nl = memchr(src + pos, '\n', len - pos);
+    return nl != NULL ? (uint32_t) (nl - src) : len;
+}
+
+#endif //ASM_SCAN_H
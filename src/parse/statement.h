@@ -0,0 +1,153 @@
+#ifndef ASM_STATEMENT_H
+#define ASM_STATEMENT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../intern.h"
+
+typedef enum statement_type {
+    STMT_DIRECTIVE,
+    STMT_INSTRUCTION,
+    STMT_LABEL,
+} statement_type_t;
+
+typedef enum argument_type {
+    ARG_NUMBER,
+    ARG_REGISTER,
+    ARG_SYMBOL,
+    ARG_STRING,
+    ARG_MEMORY,
+    // an expression that did not fold to a number or a symbol at parse time
+    ARG_EXPR,
+} argument_type_t;
+
+// Operations of an expression in postfix order. Leaves push a value, the
+// others replace the one or two on top by their result.
+typedef enum expr_opcode {
+    EXPR_NUMBER,
+    EXPR_SYMBOL,
+    // unary
+    EXPR_NEG,
+    EXPR_NOT,
+    // %hi and %lo: the upper half as lui loads it for a sign extended lower
+    // half, and the lower half
+    EXPR_HI,
+    EXPR_LO,
+    // binary, the left operand is pushed first
+    EXPR_MUL,
+    EXPR_DIV,
+    EXPR_ADD,
+    EXPR_SUB,
+    EXPR_SHL,
+    EXPR_SHR,
+    EXPR_AND,
+    EXPR_XOR,
+    EXPR_OR,
+} expr_opcode_t;
+
+typedef struct expr_op {
+    expr_opcode_t code;
+    union {
+        uint32_t num;
+        atom_t sym;
+    };
+} expr_op_t;
+
+// Longest expression in operations, after folding
+#define EXPR_MAX_OPS 64
+
+// Operations first to first + count - 1 of the expression pool of a block
+typedef struct expr_ref {
+    uint32_t first;
+    uint32_t count;
+} expr_ref_t;
+
+static inline bool expr_is_unary(expr_opcode_t code) {
+    return code >= EXPR_NEG && code <= EXPR_LO;
+}
+
+static inline const char* expr_name(expr_opcode_t code) {
+    switch (code) {
+        case EXPR_NEG:
+            return "-";
+        case EXPR_NOT:
+            return "~";
+        case EXPR_HI:
+            return "%hi";
+        case EXPR_LO:
+            return "%lo";
+        case EXPR_MUL:
+            return "*";
+        case EXPR_DIV:
+            return "/";
+        case EXPR_ADD:
+            return "+";
+        case EXPR_SUB:
+            return "-";
+        case EXPR_SHL:
+            return "<<";
+        case EXPR_SHR:
+            return ">>";
+        case EXPR_AND:
+            return "&";
+        case EXPR_XOR:
+            return "^";
+        case EXPR_OR:
+            return "|";
+        default:
+            return "?";
+    }
+}
+
+typedef struct argument {
+    argument_type_t type;
+    union {
+        uint32_t num;
+        uint32_t reg;
+        atom_t sym;
+        struct {
+            const char* ptr;
+            uint32_t len;
+        } string;
+        struct {
+            uint32_t offset;
+            uint32_t base;
+            // an offset that is not a number, `offset` is 0 then
+            expr_ref_t expr;
+        } mem;
+        expr_ref_t expr;
+    };
+} argument_t;
+
+#define MAX_ARGUMENTS 8
+
+// A single statement, as handed out by ir_get from a block
+typedef struct statement {
+    statement_type_t type;
+    uint32_t line;
+    // expression pool the operands refer to
+    const expr_op_t* exprs;
+
+    union {
+
+        struct {
+            atom_t name;
+            argument_t* argument;
+        } directive;
+
+        struct {
+            atom_t name;
+            argument_t* arguments;
+            uint32_t argc;
+        } instruction;
+
+        struct {
+            atom_t name;
+        } label;
+
+    };
+
+} statement_t;
+
+#endif //ASM_STATEMENT_H
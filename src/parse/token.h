@@ -4,6 +4,9 @@
 #include <stdint.h>
 #include <glib.h>
 
+#include "../intern.h"
+#include "statement.h"
+
 typedef enum tokentype {
     TK_DIRECTIVE,
     TK_LABEL,
@@ -13,67 +16,98 @@ typedef enum tokentype {
     TK_COMMA,
     TK_NEWLINE,
     TK_STRING,
+    TK_LPAREN,
+    TK_RPAREN,
+    // an operator of an expression, `op` is its binary form if it has one
+    TK_OPERATOR,
+    // \name, a macro parameter
+    TK_PARAM,
+    // already reported by the tokenizer, the rest of its line is skipped
+    TK_ERROR,
+    TK_EOF,
 } tokentype_t;
 
 typedef struct token {
     tokentype_t type;
     union {
-        const char* str;
-        uint32_t num;
+        atom_t atom;
+        // string literal contents, either a slice of the source or an
+        // unescaped copy in the tokenizer's arena; not NUL terminated
+        struct {
+            const char* ptr;
+            uint32_t len;
+        } string;
+        struct {
+            uint32_t num;
+            // written with a sign, which is also the operator between the
+            // number and an operand right before it: x-4 is x plus -4
+            bool sign;
+        };
         uint32_t reg;
+        expr_opcode_t op;
     };
 
+    // where the token was read from in the source
+    struct {
+        uint32_t offset;
+        uint32_t length;
+    } span;
+
     struct {
         uint32_t line;
         uint32_t column;
     };
 } token_t;
 
-static void token_free(gpointer t) {
-    token_t* token = (token_t*) t;
-    switch (token->type) {
-        case TK_DIRECTIVE:
-        case TK_LABEL:
-        case TK_SYMBOL:
-        case TK_STRING:
-            g_free((gpointer) token->str);
-            break;
-        default:
-            break;
-    }
-    g_free(token);
-}
-
-static void print_token(gpointer t, gpointer d)  {
-    token_t* token = (token_t*) t;
-    FILE* file = (FILE*) d;
+// Describes a token for an error message, long strings are cut short
+static inline void token_describe(const token_t* token, char* out, size_t size) {
     switch (token->type) {
         case TK_DIRECTIVE:
-            fprintf(file, "DIRECTIVE(%s)", token->str);
+            g_snprintf(out, size, "DIRECTIVE(%s)", atom_str(token->atom));
             break;
         case TK_LABEL:
-            fprintf(file, "LABEL(%s:)", token->str);
+            g_snprintf(out, size, "LABEL(%s:)", atom_str(token->atom));
             break;
         case TK_SYMBOL:
-            fprintf(file, "MNEMONIC(%s)", token->str);
+            g_snprintf(out, size, "MNEMONIC(%s)", atom_str(token->atom));
             break;
         case TK_REGISTER:
-            fprintf(file, "REGISTER($%d)", token->reg);
+            g_snprintf(out, size, "REGISTER($%d)", token->reg);
             break;
         case TK_NUMBER:
-            fprintf(file, "NUMBER(0x%08x)", token->num);
+            g_snprintf(out, size, "NUMBER(0x%08x)", token->num);
             break;
         case TK_STRING: {
-            gchar *str = g_strescape(token->str, NULL);
-            fprintf(file, "STRING(%s)", str);
+            gchar* raw = g_strndup(token->string.ptr, token->string.len);
+            gchar* str = g_strescape(raw, NULL);
+            g_snprintf(out, size, "STRING(%s)", str);
             g_free(str);
+            g_free(raw);
             break;
         }
         case TK_COMMA:
-            fprintf(file, "COMMA(,)");
+            g_snprintf(out, size, "COMMA(,)");
             break;
         case TK_NEWLINE:
-            fprintf(file, "NEWLINE(\\n)");
+            g_snprintf(out, size, "NEWLINE(\\n)");
+            break;
+        case TK_LPAREN:
+            g_snprintf(out, size, "LPAREN(()");
+            break;
+        case TK_RPAREN:
+            g_snprintf(out, size, "RPAREN())");
+            break;
+        case TK_OPERATOR:
+            g_snprintf(out, size, "OPERATOR(%s)", expr_name(token->op));
+            break;
+        case TK_PARAM:
+            g_snprintf(out, size, "PARAM(\\%s)", atom_str(token->atom));
+            break;
+        case TK_ERROR:
+            g_snprintf(out, size, "ERROR");
+            break;
+        case TK_EOF:
+            g_snprintf(out, size, "EOF");
             break;
     }
 }
@@ -1,185 +1,190 @@
 #include "tokenizer.h"
+#include "scan.h"
 
+#include <stdarg.h>
 #include <string.h>
 #include <ctype.h>
 
 #include <assert.h>
 
-#define TK_REQUIRE(expr, ...) {                          \
-    if (!(expr)) {                                      \
-        fprintf(stderr, "Token Error: " __VA_ARGS__);   \
-        exit(-1);                                       \
-    }                                                   \
-}
-
-void tk_tokenize(tokenizer_t* tk);
 void tk_skip_spaces(tokenizer_t* tk);
 
-void tk_read_token(tokenizer_t* tk);
-void tk_read_directive(tokenizer_t* tk);
-void tk_read_label_or_symbol(tokenizer_t* tk);
-void tk_read_number(tokenizer_t* tk);
-void tk_read_string(tokenizer_t* tk);
-void tk_read_register(tokenizer_t* tk);
+bool tk_read_token(tokenizer_t* tk, token_t* token);
+void tk_read_directive(tokenizer_t* tk, token_t* token);
+void tk_read_label_or_symbol(tokenizer_t* tk, token_t* token);
+void tk_read_number(tokenizer_t* tk, token_t* token);
+void tk_read_string(tokenizer_t* tk, token_t* token);
+void tk_read_register(tokenizer_t* tk, token_t* token);
+void tk_read_param(tokenizer_t* tk, token_t* token);
+void tk_read_operator(tokenizer_t* tk, token_t* token);
 
 uint32_t tk_remain(tokenizer_t* tk);
 
+static inline uint32_t tk_column(tokenizer_t* tk, uint32_t position) {
+    return position - tk->line_start + 1;
+}
+
+// Fills in everything but the value of a token that started at `start` on the
+// current line
+static inline void tk_finish(tokenizer_t* tk, token_t* token, tokentype_t type, uint32_t start) {
+    token->type = type;
+    token->span.offset = start;
+    token->span.length = tk->position - start;
+    token->line = tk->line;
+    token->column = tk_column(tk, start);
+}
+
+// The source is not NUL terminated (it may be a file mapping), reading past
+// the end yields '\0'.
 static inline char tk_peek(tokenizer_t* tk) {
-    return tk->src[tk->position];
+    return tk->position < tk->srclen ? tk->src[tk->position] : '\0';
 }
 
+static inline char tk_peek_next(tokenizer_t* tk) {
+    return tk->position + 1 < tk->srclen ? tk->src[tk->position + 1] : '\0';
+}
+
+// Newlines are only consumed by tk_newline, which keeps the line count
 static inline char tk_consume(tokenizer_t* tk) {
-    if (tk_peek(tk) == '\n') {
-        tk->line++;
-        tk->column = 1;
-    } else {
-        tk->column ++;
+    char c = tk_peek(tk);
+    if (tk->position < tk->srclen) {
+        tk->position++;
     }
-    return tk->src[tk->position++];
+    return c;
 }
 
-void tk_populate_registers(GHashTable* table) {
-#define R(k, v) g_hash_table_insert(table, k, (gpointer) v)
-    R("zero", 0);
-    R("at", 1);
-
-    R("v0", 2);
-    R("v1", 3);
-
-    R("a0", 4);
-    R("a1", 5);
-    R("a2", 6);
-    R("a3", 7);
-
-    R("t0", 8);
-    R("t1", 9);
-    R("t2", 10);
-    R("t3", 11);
-    R("t4", 12);
-    R("t5", 13);
-    R("t6", 14);
-    R("t7", 15);
-
-    R("s0", 16);
-    R("s1", 17);
-    R("s2", 18);
-    R("s3", 19);
-    R("s4", 20);
-    R("s5", 21);
-    R("s6", 22);
-    R("s7", 23);
-
-    R("t8", 24);
-    R("t9", 25);
-
-    R("k0", 26);
-    R("k1", 27);
-
-    R("gp", 28);
-    R("sp", 29);
-    R("fp", 30);
-    R("ra", 31);
-#undef R
+static inline void tk_newline(tokenizer_t* tk) {
+    tk->position++;
+    tk->line++;
+    tk->line_start = tk->position;
 }
 
-GQueue* tokenize(const char* src) {
-    tokenizer_t tk;
-    tk.src = src;
-    tk.srclen = strlen(src);
-    tk.position = 0;
-    tk.line = 1;
-    tk.column = 1;
-    tk.tokens = g_queue_new();
-    tk.registers = g_hash_table_new(g_str_hash, g_str_equal);
-    tk_populate_registers(tk.registers);
-
-    tk_tokenize(&tk);
+// Reports an error about the source from `start` to the current position
+// and makes `token` a TK_ERROR. The rest of the line is skipped, the parser
+// drops the statement anyway.
+static G_GNUC_PRINTF(4, 5) void tk_error(tokenizer_t* tk, token_t* token, uint32_t start, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    diag_vreport(tk->diags, tk->line, tk_column(tk, start), start, tk->position - start, format, args);
+    va_end(args);
+    token->num = 0;
+    tk_finish(tk, token, TK_ERROR, start);
+    tk->position = scan_line_end(tk->src, tk->position, tk->srclen);
+}
 
-    g_hash_table_destroy(tk.registers);
+// Maps an ABI register name to its number, or -1. Every name is at most four
+// characters and the first two decide it, so a switch beats any table.
+static int32_t tk_register_name(const char* name, uint32_t len) {
+    if (len == 4) {
+        return memcmp(name, "zero", 4) == 0 ? 0 : -1;
+    }
+    if (len != 2) {
+        return -1;
+    }
+    char c = name[1];
+    uint32_t digit = (uint32_t) (c - '0');
+    switch (name[0]) {
+        case 'a':
+            return c == 't' ? 1 : digit < 4 ? (int32_t) (4 + digit) : -1;
+        case 'v':
+            return digit < 2 ? (int32_t) (2 + digit) : -1;
+        case 't':
+            return digit < 8 ? (int32_t) (8 + digit) : digit < 10 ? (int32_t) (16 + digit) : -1;
+        case 's':
+            return c == 'p' ? 29 : digit < 8 ? (int32_t) (16 + digit) : -1;
+        case 'k':
+            return digit < 2 ? (int32_t) (26 + digit) : -1;
+        case 'g':
+            return c == 'p' ? 28 : -1;
+        case 'f':
+            return c == 'p' ? 30 : -1;
+        case 'r':
+            return c == 'a' ? 31 : -1;
+        default:
+            return -1;
+    }
+}
 
-    return tk.tokens;
+void tokenizer_init(tokenizer_t* tk, const char* src, uint32_t len, arena_t* arena) {
+    tk->src = src;
+    tk->arena = arena;
+    tk->srclen = len;
+    tk->position = 0;
+    tk->line = 1;
+    tk->line_start = 0;
+    tk->diags = NULL;
 }
 
 void tk_skip_spaces(tokenizer_t* tk) {
-    char c = tk_peek(tk);
-    while (isspace(c) && c != '\n') {
-        tk_consume(tk);
-        c = tk_peek(tk);
-    }
+    tk->position = scan_spaces(tk->src, tk->position, tk->srclen);
 }
 
-void tk_tokenize(tokenizer_t* tk) {
+void tk_next(tokenizer_t* tk, token_t* token) {
     tk_skip_spaces(tk);
     while (tk_remain(tk)) {
-        tk_read_token(tk);
+        if (tk_read_token(tk, token)) {
+            return;
+        }
         tk_skip_spaces(tk);
     }
+    token->num = 0;
+    tk_finish(tk, token, TK_EOF, tk->position);
 }
 
-void tk_read_token(tokenizer_t* tk) {
+// Returns false if nothing but a comment was read
+bool tk_read_token(tokenizer_t* tk, token_t* token) {
     char c = tk_peek(tk);
     if (c == '.') {
-        tk_read_directive(tk);
+        tk_read_directive(tk, token);
     } else if (c == '$') {
-        tk_read_register(tk);
-    } else if (isalpha(c)) {
-        tk_read_label_or_symbol(tk);
-    } else if (isdigit(c) || c == '-' || c == '+') {
-        tk_read_number(tk);
+        tk_read_register(tk, token);
+    } else if (isalpha(c) || c == '_') {
+        tk_read_label_or_symbol(tk, token);
+    } else if (isdigit(c) || ((c == '-' || c == '+') && isdigit(tk_peek_next(tk)))) {
+        tk_read_number(tk, token);
     } else if (c == '"') {
-        tk_read_string(tk);
-    } else if (c == ',') {
-        uint32_t line = tk->line, column = tk->column;
+        tk_read_string(tk, token);
+    } else if (c == '\\') {
+        tk_read_param(tk, token);
+    } else if (c != '\0' && strchr("+-*/~&|^<>%", c) != NULL) {
+        tk_read_operator(tk, token);
+    } else if (c == ',' || c == '(' || c == ')') {
+        uint32_t start = tk->position;
         tk_consume(tk);
-        token_t* token = g_new(token_t, 1);
-        token->type = TK_COMMA;
-        token->str = NULL;
-        token->line = line;
-        token->column = column;
-        g_queue_push_tail(tk->tokens, token);
+        token->num = 0;
+        tk_finish(tk, token, c == ',' ? TK_COMMA : c == '(' ? TK_LPAREN : TK_RPAREN, start);
     } else if (c == '\n') {
-        uint32_t line = tk->line, column = tk->column;
-        tk_consume(tk);
-        token_t* token = g_new(token_t, 1);
-        token->type = TK_NEWLINE;
-        token->str = NULL;
-        token->line = line;
-        token->column = column;
-        g_queue_push_tail(tk->tokens, token);
+        // the token belongs to the line it ends
+        token->num = 0;
+        tk_finish(tk, token, TK_NEWLINE, tk->position);
+        token->span.length = 1;
+        tk_newline(tk);
     } else if (c == ';') {
-        while (tk_remain(tk) && tk_peek(tk) != '\n') {
-            tk_consume(tk);
-        }
+        tk->position = scan_line_end(tk->src, tk->position, tk->srclen);
+        return false;
     } else {
-        FATAL("Unexpected character: %c\n (%d:%d)", c, tk->line, tk->column)
+        uint32_t start = tk->position, column = tk_column(tk, start);
+        tk_consume(tk);
+        tk_error(tk, token, start, "Token Error: Unexpected character: %c (%d:%d)\n", c, tk->line, column);
     }
+    return true;
 }
 
-void tk_read_directive(tokenizer_t* tk) {
-    uint32_t line = tk->line, column = tk->column;
+void tk_read_directive(tokenizer_t* tk, token_t* token) {
+    uint32_t start = tk->position;
     assert(tk_consume(tk) == '.');
 
     uint32_t pos = tk->position;
-    while (isalpha(tk_peek(tk))) {
-        tk_consume(tk);
-    }
+    tk->position = scan_ident(tk->src, pos, tk->srclen);
 
-    token_t* token = g_new(token_t, 1);
-    token->type = TK_DIRECTIVE;
-    token->str = g_strndup(tk->src + pos, tk->position - pos);
-    token->line = line;
-    token->column = column;
-
-    g_queue_push_tail(tk->tokens, token);
+    token->atom = intern(tk->src + pos, tk->position - pos);
+    tk_finish(tk, token, TK_DIRECTIVE, start);
 }
 
-void tk_read_label_or_symbol(tokenizer_t* tk) {
-    uint32_t line = tk->line, column = tk->column;
+void tk_read_label_or_symbol(tokenizer_t* tk, token_t* token) {
     uint32_t pos = tk->position;
     bool label = false;
-    while (isalpha(tk_peek(tk))) {
-        tk_consume(tk);
-    }
+    tk->position = scan_ident(tk->src, pos, tk->srclen);
     uint32_t len = tk->position - pos;
 
     if (tk_peek(tk) == ':') {
@@ -187,86 +192,257 @@ void tk_read_label_or_symbol(tokenizer_t* tk) {
         label = true;
     }
 
-    token_t* token = g_new(token_t, 1);
-    token->type = label ? TK_LABEL : TK_SYMBOL;
-    token->str = g_strndup(tk->src + pos, len);
-    token->line = line;
-    token->column = column;
+    token->atom = intern(tk->src + pos, len);
+    tk_finish(tk, token, label ? TK_LABEL : TK_SYMBOL, pos);
+}
 
-    g_queue_push_tail(tk->tokens, token);
+static inline uint32_t tk_digit_value(char c) {
+    if (c >= '0' && c <= '9') {
+        return (uint32_t) (c - '0');
+    }
+    char l = (char) (c | 0x20);
+    return l >= 'a' && l <= 'z' ? (uint32_t) (l - 'a' + 10) : UINT32_MAX;
 }
 
-void tk_read_number(tokenizer_t* tk) {
-    uint32_t line = tk->line, column = tk->column;
-    char* end;
-    token_t* token = g_new(token_t, 1);
-    token->type = TK_NUMBER;
-    token->num = strtol(tk->src + tk->position, &end, 0);
-    token->line = line;
-    token->column = column;
-    if (errno == ERANGE) {
-        FATAL("Parsed num does not fit a Word (%d:%d)", tk->line, tk->column)
+// Accumulates digits of `base` starting at tk->position into `value`. Stops
+// growing `value` once it is past `limit`, so it cannot wrap around.
+static uint32_t tk_read_digits(tokenizer_t* tk, uint32_t base, uint64_t limit, uint64_t* value) {
+    uint32_t pos = tk->position;
+    uint64_t v = *value;
+
+    if (base == 16) {
+        // whole words of eight digits, the common case for addresses and masks
+        while (pos + 8 <= tk->srclen && v <= limit) {
+            uint64_t word;
+            memcpy(&word, tk->src + pos, sizeof(word));
+            word = GUINT64_FROM_LE(word);
+            if (scan_hex_count8(word) < 8) {
+                break;
+            }
+            v = (v << 32) | scan_hex_value8(word);
+            pos += 8;
+        }
+    }
+
+    for (; pos < tk->srclen; pos++) {
+        uint32_t digit = tk_digit_value(tk->src[pos]);
+        if (digit >= base) {
+            break;
+        }
+        if (v <= limit) {
+            v = v * base + digit;
+        }
     }
-    tk->position = (size_t) end - (size_t) tk->src;
-    g_queue_push_tail(tk->tokens, token);
+
+    uint32_t count = pos - tk->position;
+    tk->position = pos;
+    *value = v;
+    return count;
 }
 
-void tk_read_string(tokenizer_t* tk) {
-    uint32_t line = tk->line, column = tk->column;
+// Decimal, 0x hex, 0b binary or 0 octal, optionally signed. Anything from
+// -2^31 to 2^32 - 1 fits a word, negative values are stored two's complement.
+void tk_read_number(tokenizer_t* tk, token_t* token) {
+    uint32_t start = tk->position;
+
+    bool negative = tk_peek(tk) == '-';
+    if (negative || tk_peek(tk) == '+') {
+        tk_consume(tk);
+    }
+
+    uint32_t base = 10;
+    if (tk_peek(tk) == '0' && tk->position + 1 < tk->srclen) {
+        char prefix = (char) (tk->src[tk->position + 1] | 0x20);
+        if (prefix == 'x' || prefix == 'b') {
+            base = prefix == 'x' ? 16 : 2;
+            tk->position += 2;
+        } else if (prefix >= '0' && prefix <= '9') {
+            base = 8;
+            tk->position++;
+        }
+    }
+
+    uint64_t limit = negative ? (uint64_t) 1 << 31 : UINT32_MAX;
+    uint64_t value = 0;
+    uint32_t digits = tk_read_digits(tk, base, limit, &value);
+    // "08", "0b2" and "12ab" are errors, not a number followed by a symbol
+    if ((digits == 0 && base != 8) || scan_is_ident(tk_peek(tk))) {
+        tk->position = scan_ident(tk->src, tk->position, tk->srclen);
+        tk_error(tk, token, start, "Token Error: Invalid number (%d:%d)\n", tk->line, tk_column(tk, start));
+        return;
+    }
+    if (value > limit) {
+        tk_error(tk, token, start, "Token Error: Parsed num does not fit a Word (%d:%d)\n", tk->line,
+                 tk_column(tk, start));
+        return;
+    }
+
+    token->num = negative ? (uint32_t) -value : (uint32_t) value;
+    token->sign = negative || tk->src[start] == '+';
+    tk_finish(tk, token, TK_NUMBER, start);
+}
+
+// Copies a string literal body into the arena, processing C escape sequences.
+// The result is never longer than the source, so one allocation suffices.
+static const char* tk_unescape(tokenizer_t* tk, const char* str, uint32_t len, uint32_t* outlen) {
+    char* out = arena_alloc(tk->arena, len + 1);
+    char* o = out;
+    for (uint32_t i = 0; i < len; i++) {
+        char c = str[i];
+        if (c != '\\' || i + 1 == len) {
+            *o++ = c;
+            continue;
+        }
+        c = str[++i];
+        switch (c) {
+            case 'n': *o++ = '\n'; break;
+            case 't': *o++ = '\t'; break;
+            case 'r': *o++ = '\r'; break;
+            case 'b': *o++ = '\b'; break;
+            case 'f': *o++ = '\f'; break;
+            case 'v': *o++ = '\v'; break;
+            case '0': case '1': case '2': case '3':
+            case '4': case '5': case '6': case '7': {
+                // up to three octal digits
+                uint32_t value = 0;
+                for (uint32_t n = 0; n < 3 && i < len && str[i] >= '0' && str[i] <= '7'; n++, i++) {
+                    value = value * 8 + (str[i] - '0');
+                }
+                i--;
+                *o++ = (char) value;
+                break;
+            }
+            default:
+                // \\, \" and unknown escapes stand for the character itself
+                *o++ = c;
+                break;
+        }
+    }
+    *o = '\0';
+    *outlen = (uint32_t) (o - out);
+    return out;
+}
+
+void tk_read_string(tokenizer_t* tk, token_t* token) {
+    uint32_t start = tk->position, line = tk->line, column = tk_column(tk, start);
     assert(tk_consume(tk) == '"');
     uint32_t pos = tk->position;
     while (tk_remain(tk) && tk_peek(tk) != '"') {
-        tk_consume(tk);
+        if (tk_consume(tk) == '\\' && tk_remain(tk)) {
+            tk_consume(tk);
+        }
     }
     uint32_t len = tk->position - pos;
     if (tk_consume(tk) != '"') {
-        FATAL("Token Error: Unexpected end of file parsing string.")
+        // lines within the literal are not counted yet, so this is where it starts
+        tk_error(tk, token, start, "Token Error: Unexpected end of file parsing string (%d:%d)\n", line, column);
+        return;
+    }
+    // only strings with escapes need a copy, the rest point into the source
+    if (memchr(tk->src + pos, '\\', len) != NULL) {
+        token->string.ptr = tk_unescape(tk, tk->src + pos, len, &token->string.len);
+    } else {
+        token->string.ptr = tk->src + pos;
+        token->string.len = len;
+    }
+    // a literal may span lines
+    uint32_t nl = pos;
+    while ((nl = scan_line_end(tk->src, nl, pos + len)) < pos + len) {
+        tk->line++;
+        tk->line_start = ++nl;
     }
-    const gchar* str = g_strndup(tk->src + pos, len);
-    const gchar* estr = g_strcompress(str);
-    g_free((gpointer) str);
-    token_t* token = g_new(token_t, 1);
-    token->type = TK_STRING;
-    token->str = estr;
+    tk_finish(tk, token, TK_STRING, start);
     token->line = line;
     token->column = column;
-    g_queue_push_tail(tk->tokens, token);
 }
 
-void tk_read_register(tokenizer_t* tk) {
-    uint32_t line = tk->line, column = tk->column;
-    assert(tk_consume(tk) == '$');
+void tk_read_register(tokenizer_t* tk, token_t* token) {
+    uint32_t start = tk->position;
+    tk_consume(tk);
     uint32_t pos = tk->position;
 
-    bool number = true;
-    while (isalnum(tk_peek(tk))) {
-        if (!isdigit(tk_peek(tk)))
-            number = false;
-        tk_consume(tk);
-    }
-
-    token_t* token = g_new(token_t, 1);
-    token->type = TK_REGISTER;
-    token->line = line;
-    token->column = column;
-
+    tk->position = scan_ident(tk->src, pos, tk->srclen);
+    const char* name = tk->src + pos;
     uint32_t len = tk->position - pos;
-    gchar* str = g_strndup(tk->src + pos, len);
 
-    if (number) {
-        token->reg = strtol(str, NULL, 10);
+    if (len > 0 && isdigit(name[0])) {
+        // numeric form, anything past 31 is left for the assembler to reject
+        uint32_t value = 0;
+        for (uint32_t i = 0; i < len; i++) {
+            if (!isdigit(name[i])) {
+                tk_error(tk, token, start, "Token Error: Invalid Register Name: %.*s (%d:%d)\n", (int) len, name,
+                         tk->line, tk_column(tk, start));
+                return;
+            }
+            value = MIN(value * 10 + (uint32_t) (name[i] - '0'), 1000);
+        }
+        token->reg = value;
     } else {
-        if (g_hash_table_contains(tk->registers, str)) {
-            token->reg = (gsize) g_hash_table_lookup(tk->registers, str);
-        } else {
-            FATAL("Invalid Register Name: %s (%d:%d)\n", str, tk->line, tk->column)
+        int32_t reg = tk_register_name(name, len);
+        if (reg < 0) {
+            tk_error(tk, token, start, "Token Error: Invalid Register Name: %.*s (%d:%d)\n", (int) len, name,
+                     tk->line, tk_column(tk, start));
+            return;
         }
+        token->reg = (uint32_t) reg;
     }
 
-    g_free(str);
-    g_queue_push_tail(tk->tokens, token);
+    tk_finish(tk, token, TK_REGISTER, start);
+}
+
+// \name refers to a parameter within a macro body
+void tk_read_param(tokenizer_t* tk, token_t* token) {
+    uint32_t start = tk->position;
+    tk_consume(tk);
+    uint32_t pos = tk->position;
+    tk->position = scan_ident(tk->src, pos, tk->srclen);
+    if (tk->position == pos) {
+        tk_error(tk, token, start, "Token Error: Unexpected character: \\ (%d:%d)\n", tk->line, tk_column(tk, start));
+        return;
+    }
+    token->atom = intern(tk->src + pos, tk->position - pos);
+    tk_finish(tk, token, TK_PARAM, start);
 }
 
+// + - * / ~ & | ^ << >> and %hi, %lo. A sign right before a digit is part of
+// the number instead.
+void tk_read_operator(tokenizer_t* tk, token_t* token) {
+    uint32_t start = tk->position, column = tk_column(tk, start);
+    char c = tk_consume(tk);
+    switch (c) {
+        case '+': token->op = EXPR_ADD; break;
+        case '-': token->op = EXPR_SUB; break;
+        case '*': token->op = EXPR_MUL; break;
+        case '/': token->op = EXPR_DIV; break;
+        case '~': token->op = EXPR_NOT; break;
+        case '&': token->op = EXPR_AND; break;
+        case '|': token->op = EXPR_OR; break;
+        case '^': token->op = EXPR_XOR; break;
+        case '<':
+        case '>':
+            if (tk_peek(tk) != c) {
+                tk_error(tk, token, start, "Token Error: Unexpected character: %c (%d:%d)\n", c, tk->line, column);
+                return;
+            }
+            tk_consume(tk);
+            token->op = c == '<' ? EXPR_SHL : EXPR_SHR;
+            break;
+        default: {
+            uint32_t pos = tk->position;
+            tk->position = scan_ident(tk->src, pos, tk->srclen);
+            const char* name = tk->src + pos;
+            uint32_t len = tk->position - pos;
+            if (len == 2 && (memcmp(name, "hi", 2) == 0 || memcmp(name, "lo", 2) == 0)) {
+                token->op = name[0] == 'h' ? EXPR_HI : EXPR_LO;
+                break;
+            }
+            tk_error(tk, token, start, "Token Error: Unknown operator: %%%.*s (%d:%d)\n", (int) len, name, tk->line,
+                     column);
+            return;
+        }
+    }
+    tk_finish(tk, token, TK_OPERATOR, start);
+}
 
 uint32_t tk_remain(tokenizer_t* tk) {
     return tk->srclen - tk->position;
@@ -3,23 +3,34 @@
 
 #include <mips-as/prelude.h>
 #include "token.h"
+#include "../arena.h"
+#include "../diag.h"
 
 #include <stdint.h>
 #include <glib.h>
 
 typedef struct tokenizer {
-    GQueue* tokens;
-
     const char* src;
     uint32_t srclen;
     uint32_t position;
 
+    // line/column are derived from these only when a token is produced
     uint32_t line;
-    uint32_t column;
+    uint32_t line_start;
+
+    // string literals are unescaped here, they live until the owner resets it
+    arena_t* arena;
 
-    GHashTable* registers;
+    // errors are recorded here as TK_ERROR tokens if set, otherwise they are
+    // fatal
+    diagnostics_t* diags;
 } tokenizer_t;
 
-GQueue* tokenize(const char* src);
+// `src` does not need to be NUL terminated, tokens refer back into it by span
+void tokenizer_init(tokenizer_t* tk, const char* src, uint32_t len, arena_t* arena);
+
+// Reads the next token into `token`. Once the source is exhausted every call
+// yields TK_EOF.
+void tk_next(tokenizer_t* tk, token_t* token);
 
 #endif // ASM_TOKENIZER_H
@@ -0,0 +1,531 @@
+#include "sim.h"
+#include "opcodes.h"
+
+#include <stdarg.h>
+#include <string.h>
+
+enum {
+    SIM_UNDECODED,
+#define OP(name, format, layout, opcode, funct, flags) SIM_##name,
+#include "opcodes.def"
+#undef OP
+    SIM_RESERVED,
+};
+
+// Decode tables indexed by the opcode field, the funct field of SPECIAL
+// (opcode 0) and the rt field of REGIMM (opcode 1)
+static uint8_t primary_ops[64];
+static uint8_t special_ops[64];
+static uint8_t regimm_ops[32];
+
+static void decode_add(uint8_t op, opformat_t format, uint8_t opcode, uint8_t funct) {
+    if (format == FMT_R) {
+        special_ops[funct] = op;
+    } else if (format == FMT_I && opcode == 0x01) {
+        regimm_ops[funct] = op;
+    } else if (format != FMT_PSEUDO) {
+        primary_ops[opcode] = op;
+    }
+}
+
+static void decode_init(void) {
+    static gsize once = 0;
+    if (g_once_init_enter(&once)) {
+        memset(primary_ops, SIM_RESERVED, sizeof(primary_ops));
+        memset(special_ops, SIM_RESERVED, sizeof(special_ops));
+        memset(regimm_ops, SIM_RESERVED, sizeof(regimm_ops));
+#define OP(name, format, layout, opcode, funct, flags) decode_add(SIM_##name, format, opcode, funct);
+#include "opcodes.def"
+#undef OP
+        g_once_init_leave(&once, 1);
+    }
+}
+
+static void decode(uint32_t word, sim_insn_t* insn) {
+    uint32_t opcode = word >> 26;
+    insn->rs = (word >> 21) & 31;
+    insn->rt = (word >> 16) & 31;
+    insn->rd = (word >> 11) & 31;
+    insn->imm = (uint32_t) (int32_t) (int16_t) (word & 0xffff);
+    if (opcode == 0x00) {
+        insn->op = special_ops[word & 63];
+        insn->imm = (word >> 6) & 31;
+    } else if (opcode == 0x01) {
+        insn->op = regimm_ops[insn->rt];
+    } else {
+        insn->op = primary_ops[opcode];
+    }
+
+    switch (insn->op) {
+        case SIM_andi:
+        case SIM_ori:
+        case SIM_xori:
+            insn->imm = word & 0xffff;
+            break;
+        case SIM_lui:
+            insn->imm = word << 16;
+            break;
+        case SIM_beq:
+        case SIM_bne:
+        case SIM_blez:
+        case SIM_bgtz:
+        case SIM_bltz:
+        case SIM_bgez:
+            // byte offset from the delay slot
+            insn->imm <<= 2;
+            break;
+        case SIM_j:
+        case SIM_jal:
+            insn->imm = (word & 0x03ffffff) << 2;
+            break;
+        default:
+            break;
+    }
+}
+
+static void sim_fault(sim_t* sim, const char* format, ...) G_GNUC_PRINTF(2, 3);
+
+static void sim_fault(sim_t* sim, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    g_vsnprintf(sim->fault, sizeof(sim->fault), format, args);
+    va_end(args);
+}
+
+void sim_init(sim_t* sim, const assembler_t* as) {
+    decode_init();
+    memset(sim, 0, sizeof(*sim));
+    sim->big_endian = as->big_endian;
+
+    sim->text = as->textbuff.data;
+    sim->textbase = as->textbuff.base;
+    sim->textsize = as->textbuff.size;
+    sim->decoded = g_new0(sim_insn_t, sim->textsize / 4 + 1);
+
+    // sbrk hands out 8 byte aligned blocks from the end of .data
+    sim->database = as->databuff.base;
+    sim->datasize = (as->databuff.size + 7) & ~7u;
+    sim->datacapacity = MAX(sim->datasize, 64);
+    sim->data = g_malloc0(sim->datacapacity);
+    memcpy(sim->data, as->databuff.data, as->databuff.size);
+    sim->stack = g_malloc0(SIM_STACK_SIZE);
+
+    sim->out = g_string_new(NULL);
+    sim->regs[28] = SIM_GP;
+    sim->regs[29] = SIM_SP;
+
+    symbol_t* entry = g_hash_table_lookup(as->symbols.symbols, GUINT_TO_POINTER(intern("main", 4)));
+    bool has_main = entry != NULL && entry->defined && entry->sector == SECTOR_TEXT;
+    sim->pc = has_main ? entry->address : sim->textbase;
+    sim->npc = sim->pc + 4;
+}
+
+void sim_free(sim_t* sim) {
+    g_free(sim->decoded);
+    g_free(sim->data);
+    g_free(sim->stack);
+    g_string_free(sim->out, TRUE);
+}
+
+// Memory
+
+// Pointer to `address` and the number of bytes mapped from there on, NULL
+// if nothing is. Text is read only.
+static uint8_t* sim_map(sim_t* sim, uint32_t address, uint32_t* avail, bool write) {
+    uint32_t offset = address - sim->database;
+    if (offset < sim->datasize) {
+        *avail = sim->datasize - offset;
+        return sim->data + offset;
+    }
+    offset = address - (SIM_STACK_TOP - SIM_STACK_SIZE);
+    if (offset < SIM_STACK_SIZE) {
+        *avail = SIM_STACK_SIZE - offset;
+        return sim->stack + offset;
+    }
+    offset = address - sim->textbase;
+    if (!write && offset < sim->textsize) {
+        *avail = sim->textsize - offset;
+        return (uint8_t*) sim->text + offset;
+    }
+    return NULL;
+}
+
+// `size` bytes at an address aligned to `size`, or NULL after a fault
+static inline uint8_t* sim_access(sim_t* sim, uint32_t address, uint32_t size, bool write) {
+    uint32_t avail = 0;
+    uint8_t* bytes = (address & (size - 1)) == 0 ? sim_map(sim, address, &avail, write) : NULL;
+    if (G_UNLIKELY(bytes == NULL || avail < size)) {
+        sim_fault(sim, "bad %s of %u bytes at 0x%08x", write ? "store" : "load", size, address);
+        return NULL;
+    }
+    return bytes;
+}
+
+static inline uint32_t sim_get32(const sim_t* sim, const uint8_t* bytes) {
+    uint32_t value;
+    memcpy(&value, bytes, sizeof(value));
+    return sim->big_endian ? GUINT32_FROM_BE(value) : GUINT32_FROM_LE(value);
+}
+
+static inline uint16_t sim_get16(const sim_t* sim, const uint8_t* bytes) {
+    uint16_t value;
+    memcpy(&value, bytes, sizeof(value));
+    return sim->big_endian ? GUINT16_FROM_BE(value) : GUINT16_FROM_LE(value);
+}
+
+static inline void sim_set32(const sim_t* sim, uint8_t* bytes, uint32_t value) {
+    value = sim->big_endian ? GUINT32_TO_BE(value) : GUINT32_TO_LE(value);
+    memcpy(bytes, &value, sizeof(value));
+}
+
+static inline void sim_set16(const sim_t* sim, uint8_t* bytes, uint16_t value) {
+    value = sim->big_endian ? GUINT16_TO_BE(value) : GUINT16_TO_LE(value);
+    memcpy(bytes, &value, sizeof(value));
+}
+
+// Grows the heap by `amount` bytes and returns where the new block starts
+static bool sim_sbrk(sim_t* sim, int32_t amount, uint32_t* address) {
+    uint32_t size = ((uint32_t) amount + 7) & ~7u;
+    if (amount < 0 || size > SIM_DATA_MAX - sim->datasize) {
+        sim_fault(sim, "sbrk of %d bytes does not fit", amount);
+        return false;
+    }
+    if (sim->datasize + size > sim->datacapacity) {
+        uint32_t capacity = MAX(sim->datacapacity * 2, sim->datasize + size);
+        sim->data = g_realloc(sim->data, capacity);
+        memset(sim->data + sim->datacapacity, 0, capacity - sim->datacapacity);
+        sim->datacapacity = capacity;
+    }
+    *address = sim->database + sim->datasize;
+    sim->datasize += size;
+    return true;
+}
+
+// Returns false if the program stops
+static bool sim_syscall(sim_t* sim, sim_status_t* status) {
+    uint32_t* r = sim->regs;
+    uint32_t arg = r[4];
+    switch (r[2]) {
+        case 1:
+            g_string_append_printf(sim->out, "%d", (int32_t) arg);
+            return true;
+        case 4: {
+            uint32_t avail;
+            const uint8_t* str = sim_map(sim, arg, &avail, false);
+            const uint8_t* end = str != NULL ? memchr(str, 0, avail) : NULL;
+            if (end == NULL) {
+                sim_fault(sim, "no string at 0x%08x", arg);
+                *status = SIM_FAULT;
+                return false;
+            }
+            g_string_append_len(sim->out, (const gchar*) str, end - str);
+            return true;
+        }
+        case 9:
+            if (!sim_sbrk(sim, (int32_t) arg, &r[2])) {
+                *status = SIM_FAULT;
+                return false;
+            }
+            return true;
+        case 10:
+            sim->exit_code = 0;
+            *status = SIM_EXITED;
+            return false;
+        case 11:
+            g_string_append_c(sim->out, (gchar) arg);
+            return true;
+        case 17:
+            sim->exit_code = (int32_t) arg;
+            *status = SIM_EXITED;
+            return false;
+        default:
+            sim_fault(sim, "unsupported syscall %d", (int32_t) r[2]);
+            *status = SIM_FAULT;
+            return false;
+    }
+}
+
+// Interpreter
+
+// Loads and stores leave the loop after a fault
+#define LOAD(size, expr) {                                                      \
+    const uint8_t* m = sim_access(sim, r[insn->rs] + insn->imm, (size), false); \
+    if (m == NULL) {                                                            \
+        status = SIM_FAULT;                                                     \
+        running = false;                                                        \
+        break;                                                                  \
+    }                                                                           \
+    r[insn->rt] = (expr);                                                       \
+    break;                                                                      \
+}
+
+#define STORE(size, stmt) {                                                     \
+    uint8_t* m = sim_access(sim, r[insn->rs] + insn->imm, (size), true);        \
+    if (m == NULL) {                                                            \
+        status = SIM_FAULT;                                                     \
+        running = false;                                                        \
+        break;                                                                  \
+    }                                                                           \
+    stmt;                                                                       \
+    break;                                                                      \
+}
+
+#define TRAP(message) {                                                         \
+    sim_fault(sim, message);                                                    \
+    status = SIM_FAULT;                                                         \
+    running = false;                                                            \
+    break;                                                                      \
+}
+
+sim_status_t sim_run(sim_t* sim, uint64_t max_steps) {
+    uint32_t* r = sim->regs;
+    uint32_t pc = sim->pc;
+    uint32_t npc = sim->npc;
+    uint64_t steps = sim->steps;
+    uint64_t end = max_steps == 0 ? UINT64_MAX : steps + max_steps;
+    uint32_t words = sim->textsize / 4;
+    sim_status_t status = SIM_LIMIT;
+    bool running = true;
+
+    while (running && steps < end) {
+        uint32_t index = (pc - sim->textbase) >> 2;
+        if (G_UNLIKELY(index >= words || (pc & 3) != 0)) {
+            // main returned to the $ra it started with
+            if (pc == 0) {
+                sim->exit_code = 0;
+                status = SIM_EXITED;
+            } else {
+                sim_fault(sim, "no instruction at 0x%08x", pc);
+                status = SIM_FAULT;
+            }
+            break;
+        }
+        sim_insn_t* insn = &sim->decoded[index];
+        if (G_UNLIKELY(insn->op == SIM_UNDECODED)) {
+            decode(sim_get32(sim, sim->text + 4 * index), insn);
+        }
+        steps++;
+
+        // where execution continues after the instruction at npc, which is
+        // the delay slot if this one is a branch
+        uint32_t next = npc + 4;
+        uint32_t rs = r[insn->rs];
+        uint32_t rt = r[insn->rt];
+        int32_t result;
+        switch (insn->op) {
+            case SIM_add:
+                if (__builtin_add_overflow((int32_t) rs, (int32_t) rt, &result)) {
+                    TRAP("arithmetic overflow")
+                }
+                r[insn->rd] = (uint32_t) result;
+                break;
+            case SIM_addu:
+                r[insn->rd] = rs + rt;
+                break;
+            case SIM_sub:
+                if (__builtin_sub_overflow((int32_t) rs, (int32_t) rt, &result)) {
+                    TRAP("arithmetic overflow")
+                }
+                r[insn->rd] = (uint32_t) result;
+                break;
+            case SIM_subu:
+                r[insn->rd] = rs - rt;
+                break;
+            case SIM_and:
+                r[insn->rd] = rs & rt;
+                break;
+            case SIM_or:
+                r[insn->rd] = rs | rt;
+                break;
+            case SIM_xor:
+                r[insn->rd] = rs ^ rt;
+                break;
+            case SIM_nor:
+                r[insn->rd] = ~(rs | rt);
+                break;
+            case SIM_slt:
+                r[insn->rd] = (int32_t) rs < (int32_t) rt;
+                break;
+            case SIM_sltu:
+                r[insn->rd] = rs < rt;
+                break;
+
+            case SIM_sll:
+                r[insn->rd] = rt << insn->imm;
+                break;
+            case SIM_srl:
+                r[insn->rd] = rt >> insn->imm;
+                break;
+            case SIM_sra:
+                r[insn->rd] = (uint32_t) ((int32_t) rt >> insn->imm);
+                break;
+            case SIM_sllv:
+                r[insn->rd] = rt << (rs & 31);
+                break;
+            case SIM_srlv:
+                r[insn->rd] = rt >> (rs & 31);
+                break;
+            case SIM_srav:
+                r[insn->rd] = (uint32_t) ((int32_t) rt >> (rs & 31));
+                break;
+
+            case SIM_mult: {
+                int64_t product = (int64_t) (int32_t) rs * (int32_t) rt;
+                sim->lo = (uint32_t) product;
+                sim->hi = (uint32_t) ((uint64_t) product >> 32);
+                break;
+            }
+            case SIM_multu: {
+                uint64_t product = (uint64_t) rs * rt;
+                sim->lo = (uint32_t) product;
+                sim->hi = (uint32_t) (product >> 32);
+                break;
+            }
+            case SIM_div:
+                // the result of a division by zero is unpredictable, hi and
+                // lo are left alone
+                if (rt == 0) {
+                    break;
+                }
+                if ((int32_t) rs == INT32_MIN && (int32_t) rt == -1) {
+                    sim->lo = rs;
+                    sim->hi = 0;
+                } else {
+                    sim->lo = (uint32_t) ((int32_t) rs / (int32_t) rt);
+                    sim->hi = (uint32_t) ((int32_t) rs % (int32_t) rt);
+                }
+                break;
+            case SIM_divu:
+                if (rt != 0) {
+                    sim->lo = rs / rt;
+                    sim->hi = rs % rt;
+                }
+                break;
+            case SIM_mfhi:
+                r[insn->rd] = sim->hi;
+                break;
+            case SIM_mflo:
+                r[insn->rd] = sim->lo;
+                break;
+            case SIM_mthi:
+                sim->hi = rs;
+                break;
+            case SIM_mtlo:
+                sim->lo = rs;
+                break;
+
+            case SIM_jr:
+                next = rs;
+                break;
+            case SIM_jalr:
+                r[insn->rd] = pc + 8;
+                next = rs;
+                break;
+            case SIM_syscall:
+                running = sim_syscall(sim, &status);
+                break;
+            case SIM_break:
+                TRAP("break")
+
+            case SIM_addi:
+                if (__builtin_add_overflow((int32_t) rs, (int32_t) insn->imm, &result)) {
+                    TRAP("arithmetic overflow")
+                }
+                r[insn->rt] = (uint32_t) result;
+                break;
+            case SIM_addiu:
+                r[insn->rt] = rs + insn->imm;
+                break;
+            case SIM_slti:
+                r[insn->rt] = (int32_t) rs < (int32_t) insn->imm;
+                break;
+            case SIM_sltiu:
+                r[insn->rt] = rs < insn->imm;
+                break;
+            case SIM_andi:
+                r[insn->rt] = rs & insn->imm;
+                break;
+            case SIM_ori:
+                r[insn->rt] = rs | insn->imm;
+                break;
+            case SIM_xori:
+                r[insn->rt] = rs ^ insn->imm;
+                break;
+            case SIM_lui:
+                r[insn->rt] = insn->imm;
+                break;
+
+            case SIM_lb:
+                LOAD(1, (uint32_t) (int32_t) (int8_t) m[0])
+            case SIM_lbu:
+                LOAD(1, m[0])
+            case SIM_lh:
+                LOAD(2, (uint32_t) (int32_t) (int16_t) sim_get16(sim, m))
+            case SIM_lhu:
+                LOAD(2, sim_get16(sim, m))
+            case SIM_lw:
+                LOAD(4, sim_get32(sim, m))
+            case SIM_sb:
+                STORE(1, m[0] = (uint8_t) rt)
+            case SIM_sh:
+                STORE(2, sim_set16(sim, m, (uint16_t) rt))
+            case SIM_sw:
+                STORE(4, sim_set32(sim, m, rt))
+
+            case SIM_beq:
+                if (rs == rt) {
+                    next = pc + 4 + insn->imm;
+                }
+                break;
+            case SIM_bne:
+                if (rs != rt) {
+                    next = pc + 4 + insn->imm;
+                }
+                break;
+            case SIM_blez:
+                if ((int32_t) rs <= 0) {
+                    next = pc + 4 + insn->imm;
+                }
+                break;
+            case SIM_bgtz:
+                if ((int32_t) rs > 0) {
+                    next = pc + 4 + insn->imm;
+                }
+                break;
+            case SIM_bltz:
+                if ((int32_t) rs < 0) {
+                    next = pc + 4 + insn->imm;
+                }
+                break;
+            case SIM_bgez:
+                if ((int32_t) rs >= 0) {
+                    next = pc + 4 + insn->imm;
+                }
+                break;
+
+            case SIM_jal:
+                r[31] = pc + 8;
+                next = ((pc + 4) & 0xf0000000) | insn->imm;
+                break;
+            case SIM_j:
+                next = ((pc + 4) & 0xf0000000) | insn->imm;
+                break;
+
+            default:
+                TRAP("reserved instruction")
+        }
+        r[0] = 0;
+        if (running) {
+            pc = npc;
+            npc = next;
+        }
+    }
+
+    if (status == SIM_FAULT) {
+        sim->fault_pc = pc;
+    }
+    sim->pc = pc;
+    sim->npc = npc;
+    sim->steps = steps;
+    return status;
+}
@@ -0,0 +1,78 @@
+#ifndef ASM_SIM_H
+#define ASM_SIM_H
+
+#include <mips-as/prelude.h>
+#include "assembler.h"
+
+// Where the stack ends and $sp starts, as in SPIM and MARS
+#define SIM_STACK_TOP 0x80000000u
+#define SIM_STACK_SIZE (1u << 20)
+#define SIM_SP 0x7fffeffcu
+#define SIM_GP 0x10008000u
+// Largest the data segment may grow to through sbrk
+#define SIM_DATA_MAX (64u << 20)
+
+typedef enum sim_status {
+    SIM_EXITED,
+    // bad address, reserved instruction, overflow trap or break
+    SIM_FAULT,
+    // the step limit was reached first
+    SIM_LIMIT,
+} sim_status_t;
+
+// A text word decoded into what the interpreter needs. `op` is one of the
+// SIM_* values generated from opcodes.def, SIM_UNDECODED until the word is
+// first executed.
+typedef struct sim_insn {
+    uint8_t op;
+    uint8_t rd;
+    uint8_t rs;
+    uint8_t rt;
+    // sign or zero extended immediate, shift amount, or jump target
+    uint32_t imm;
+} sim_insn_t;
+
+// Runs the output of a non relocatable assembly in-process. Execution
+// starts at `main` (or the start of .text) with $ra = 0, so main returning
+// ends the program like syscall 10 does. Syscalls follow the SPIM
+// conventions: the service in $v0, the argument in $a0.
+typedef struct sim {
+    uint32_t regs[32];
+    uint32_t hi;
+    uint32_t lo;
+    uint32_t pc;
+    // address of the next instruction, the target of a branch once its
+    // delay slot runs
+    uint32_t npc;
+    bool big_endian;
+
+    // borrowed from the assembler, which must outlive the simulator
+    const uint8_t* text;
+    uint32_t textbase;
+    uint32_t textsize;
+    sim_insn_t* decoded;
+
+    // .data followed by the heap sbrk hands out, `datasize` bytes in all
+    uint8_t* data;
+    uint32_t database;
+    uint32_t datasize;
+    uint32_t datacapacity;
+    uint8_t* stack;
+
+    // everything the program printed
+    GString* out;
+    uint64_t steps;
+    int32_t exit_code;
+    // reason and address of a fault
+    char fault[64];
+    uint32_t fault_pc;
+} sim_t;
+
+void sim_init(sim_t* sim, const assembler_t* as);
+void sim_free(sim_t* sim);
+
+// Runs until the program exits, faults or has executed `max_steps` more
+// instructions (0 for no limit). A run stopped by the limit can be resumed.
+sim_status_t sim_run(sim_t* sim, uint64_t max_steps);
+
+#endif //ASM_SIM_H
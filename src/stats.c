@@ -0,0 +1,76 @@
+#include "stats.h"
+
+static const char* phase_names[PHASE_COUNT] = {
+    [PHASE_TOKENIZE] = "tokenize",
+    [PHASE_PARSE] = "parse",
+    [PHASE_ASSEMBLE] = "assemble",
+};
+
+static const char* item_names[PHASE_COUNT] = {
+    [PHASE_TOKENIZE] = "tokens",
+    [PHASE_PARSE] = "statements",
+    [PHASE_ASSEMBLE] = "statements",
+};
+
+uint64_t stats_nanos(const stats_t* stats) {
+    uint64_t nanos = 0;
+    for (uint32_t i = 0; i < PHASE_COUNT; i++) {
+        nanos += stats->phases[i].nanos;
+    }
+    return nanos;
+}
+
+void stats_add(stats_t* into, const stats_t* from) {
+    for (uint32_t i = 0; i < PHASE_COUNT; i++) {
+        into->phases[i].nanos += from->phases[i].nanos;
+        into->phases[i].bytes += from->phases[i].bytes;
+        into->phases[i].items += from->phases[i].items;
+        into->phases[i].allocations += from->phases[i].allocations;
+    }
+}
+
+void stats_print(GString* out, const char* name, const stats_t* stats) {
+    g_string_append_printf(out, "%s: %.3f ms wall, %u thread%s%s\n", name, stats->wall / 1e6, stats->threads,
+                           stats->threads == 1 ? "" : "s", stats->cached ? ", cached" : "");
+    for (uint32_t i = 0; i < PHASE_COUNT; i++) {
+        const phase_stats_t* phase = &stats->phases[i];
+        double seconds = phase->nanos / 1e9;
+        g_string_append_printf(out, "  %-10s %10.3f ms %10.1f MB/s %12" G_GUINT64_FORMAT " %-10s %8"
+                               G_GUINT64_FORMAT " allocs\n", phase_names[i], phase->nanos / 1e6,
+                               seconds > 0 ? phase->bytes / seconds / 1e6 : 0.0, phase->items, item_names[i],
+                               phase->allocations);
+    }
+    g_string_append_printf(out, "  delay slots %" G_GUINT64_FORMAT " of %" G_GUINT64_FORMAT " filled\n",
+                           stats->delay_filled, stats->delay_slots);
+}
+
+static void append_json_string(GString* out, const char* str) {
+    g_string_append_c(out, '"');
+    for (const char* c = str; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\') {
+            g_string_append_c(out, '\\');
+            g_string_append_c(out, *c);
+        } else if ((unsigned char) *c < 0x20) {
+            g_string_append_printf(out, "\\u%04x", (unsigned char) *c);
+        } else {
+            g_string_append_c(out, *c);
+        }
+    }
+    g_string_append_c(out, '"');
+}
+
+void stats_print_json(GString* out, const char* name, const stats_t* stats) {
+    g_string_append(out, "{\"file\":");
+    append_json_string(out, name);
+    g_string_append_printf(out, ",\"wall_ns\":%" G_GUINT64_FORMAT ",\"threads\":%u,\"cached\":%s,\"phases\":{",
+                           stats->wall, stats->threads, stats->cached ? "true" : "false");
+    for (uint32_t i = 0; i < PHASE_COUNT; i++) {
+        const phase_stats_t* phase = &stats->phases[i];
+        g_string_append_printf(out, "%s\"%s\":{\"ns\":%" G_GUINT64_FORMAT ",\"bytes\":%" G_GUINT64_FORMAT
+                               ",\"%s\":%" G_GUINT64_FORMAT ",\"allocations\":%" G_GUINT64_FORMAT "}",
+                               i > 0 ? "," : "", phase_names[i], phase->nanos, phase->bytes, item_names[i],
+                               phase->items, phase->allocations);
+    }
+    g_string_append_printf(out, "},\"delay_slots\":%" G_GUINT64_FORMAT ",\"delay_filled\":%" G_GUINT64_FORMAT "}",
+                           stats->delay_slots, stats->delay_filled);
+}
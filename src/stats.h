@@ -0,0 +1,55 @@
+#ifndef ASM_STATS_H
+#define ASM_STATS_H
+
+#include <mips-as/prelude.h>
+
+#include <time.h>
+
+// Counters behind --stats. Nothing is collected unless a stats_t is attached
+// to the assembler; when it is not, the cost is a never-taken branch per
+// token and per block.
+
+typedef enum phase {
+    PHASE_TOKENIZE,
+    PHASE_PARSE,
+    PHASE_ASSEMBLE,
+    PHASE_COUNT,
+} phase_t;
+
+typedef struct phase_stats {
+    // time spent in the phase itself, summed over threads
+    uint64_t nanos;
+    // source bytes read (tokenize, parse) or output bytes (assemble)
+    uint64_t bytes;
+    // tokens (tokenize) or statements (parse, assemble)
+    uint64_t items;
+    // heap allocations: arena chunks, IR blocks, section buffers and symbols
+    uint64_t allocations;
+} phase_stats_t;
+
+typedef struct stats {
+    phase_stats_t phases[PHASE_COUNT];
+    uint64_t wall;
+    uint32_t threads;
+    bool cached;
+    // branch delay slots emitted, and those filled by -O
+    uint64_t delay_slots;
+    uint64_t delay_filled;
+} stats_t;
+
+static inline uint64_t stats_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+// Time of all phases together
+uint64_t stats_nanos(const stats_t* stats);
+
+// Adds the phase counters of `from` to `into`
+void stats_add(stats_t* into, const stats_t* from);
+
+void stats_print(GString* out, const char* name, const stats_t* stats);
+void stats_print_json(GString* out, const char* name, const stats_t* stats);
+
+#endif //ASM_STATS_H
@@ -0,0 +1,71 @@
+#include "symbols.h"
+
+void symtab_init(symtab_t* table) {
+    table->symbols = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+    table->fixups = g_array_new(FALSE, FALSE, sizeof(fixup_t));
+    table->unused = FIXUP_NONE;
+}
+
+void symtab_free(symtab_t* table) {
+    g_hash_table_destroy(table->symbols);
+    g_array_free(table->fixups, TRUE);
+}
+
+void symtab_clear(symtab_t* table) {
+    g_hash_table_remove_all(table->symbols);
+    g_array_set_size(table->fixups, 0);
+    table->unused = FIXUP_NONE;
+}
+
+symbol_t* symtab_get(symtab_t* table, atom_t name) {
+    symbol_t* sym = g_hash_table_lookup(table->symbols, GUINT_TO_POINTER(name));
+    if (sym == NULL) {
+        sym = g_new(symbol_t, 1);
+        sym->name = name;
+        sym->defined = false;
+        sym->global = false;
+        sym->sector = 0;
+        sym->address = 0;
+        sym->line = 0;
+        sym->fixups = FIXUP_NONE;
+        g_hash_table_insert(table->symbols, GUINT_TO_POINTER(name), sym);
+    }
+    return sym;
+}
+
+void symtab_add_fixup(symtab_t* table, symbol_t* sym, fixup_t fixup) {
+    fixup.next = sym->fixups;
+    if (table->unused != FIXUP_NONE) {
+        sym->fixups = table->unused;
+        table->unused = symtab_fixup(table, table->unused)->next;
+        *symtab_fixup(table, sym->fixups) = fixup;
+    } else {
+        sym->fixups = (int32_t) table->fixups->len;
+        g_array_append_val(table->fixups, fixup);
+    }
+}
+
+bool symtab_take_fixup(symtab_t* table, symbol_t* sym, fixup_t* fixup) {
+    int32_t index = sym->fixups;
+    if (index == FIXUP_NONE) {
+        return false;
+    }
+    *fixup = *symtab_fixup(table, index);
+    sym->fixups = fixup->next;
+    symtab_fixup(table, index)->next = table->unused;
+    table->unused = index;
+    return true;
+}
+
+void symtab_release_fixups(symtab_t* table, symbol_t* sym) {
+    int32_t index = sym->fixups;
+    if (index == FIXUP_NONE) {
+        return;
+    }
+    while (symtab_fixup(table, index)->next != FIXUP_NONE) {
+        index = symtab_fixup(table, index)->next;
+    }
+    symtab_fixup(table, index)->next = table->unused;
+    table->unused = sym->fixups;
+    sym->fixups = FIXUP_NONE;
+}
@@ -0,0 +1,82 @@
+#ifndef ASM_SYMBOLS_H
+#define ASM_SYMBOLS_H
+
+#include <mips-as/prelude.h>
+#include "intern.h"
+
+typedef enum fixup_kind {
+    FIXUP_HI16,     // upper half of an absolute address (lui)
+    FIXUP_LO16,     // lower half of an absolute address (addiu)
+    FIXUP_PC16,     // branch offset relative to the delay slot
+    FIXUP_J26,      // jump target within the current 256MB region
+    FIXUP_WORD32,   // full 32 bit address (.word)
+} fixup_kind_t;
+
+#define FIXUP_NONE (-1)
+
+// A word waiting for a symbol to be defined, to be filled with its address
+// plus `addend`. Fixups of the same symbol are chained through `next`, which
+// indexes the symbol table's fixup pool.
+typedef struct fixup {
+    fixup_kind_t kind;
+    uint32_t sector;
+    uint32_t offset;
+    uint32_t line;
+    uint32_t addend;
+    int32_t next;
+} fixup_t;
+
+typedef struct symbol {
+    atom_t name;
+    bool defined;
+    bool global;
+    uint32_t sector;
+    uint32_t address;
+    uint32_t line;
+    int32_t fixups;
+} symbol_t;
+
+// A word whose field `kind` must be filled with the address of `symbol` plus
+// `value`, or with `value` if symbol is ATOM_NONE. Used when the final
+// address of the word itself is not known yet, so nothing can be patched in
+// place. Relocations of relocatable output use the same record, there
+// ATOM_NONE refers to the start of section `value` and the addend is in place.
+typedef struct reference {
+    fixup_kind_t kind;
+    uint32_t sector;
+    uint32_t offset;
+    uint32_t line;
+    atom_t symbol;
+    uint32_t value;
+    // of a relocation, which the word holds in place. HI16 and LO16 pair up
+    // by target and addend.
+    uint32_t addend;
+    // the upper half of an `la`, which a sequential run may have shortened
+    bool la;
+} reference_t;
+
+typedef struct symtab {
+    GHashTable* symbols;
+    GArray* fixups;
+    int32_t unused;     // chain of resolved fixups available for reuse
+} symtab_t;
+
+void symtab_init(symtab_t* table);
+void symtab_free(symtab_t* table);
+// Removes every symbol, keeping the allocations for reuse
+void symtab_clear(symtab_t* table);
+
+// Returns the symbol with the given name, creating an undefined one if needed
+symbol_t* symtab_get(symtab_t* table, atom_t name);
+void symtab_add_fixup(symtab_t* table, symbol_t* sym, fixup_t fixup);
+// Hands the fixup chain of a resolved symbol back to the pool
+void symtab_release_fixups(symtab_t* table, symbol_t* sym);
+// Removes the first fixup of `sym` into `fixup` and hands its slot back to
+// the pool, false if there is none
+bool symtab_take_fixup(symtab_t* table, symbol_t* sym, fixup_t* fixup);
+
+static inline fixup_t* symtab_fixup(symtab_t* table, int32_t index) {
+    return &g_array_index(table->fixups, fixup_t, index);
+}
+
+#endif //ASM_SYMBOLS_H
@@ -0,0 +1,18 @@
+; every error is reported, assembly goes on with the next statement
+.text
+main:
+    li $t4, -
+    addiu $t0, $t1, 1+
+    li $t0, %x(1)
+    li $t1, 1 < 2
+    li $t2, 1/0
+    addu $t0, $t1, $t9x
+    lw $t0, 4(
+    addiu $t0, $t1, 0x12345
+    beq $t0, $t1, nowhere
+    nop
+main:
+    .word a*b
+a:
+b:
+    j main
@@ -0,0 +1,34 @@
+.data
+msg: .asciiz "hello"
+.align 2
+tab: .word msg+4
+     .word 0
+     .word (1<<16)|0x30
+     .half 3*4-1
+     .byte ~0 & 0x7f
+     .space 2*2
+.text
+start:
+    lui $t0, %hi(msg)
+    addiu $t0, $t0, %lo(msg)
+    lui $t1, %hi(later+8)
+    lw $t2, %lo(later+8)($t1)
+    li $t3, (1<<16)|0x30
+    li $t4, -(3*4)/2
+    addiu $t5, $zero, 10-3-2
+    addiu $t5, $zero, 10 - 3 - 2
+    ori $t6, $zero, %lo(0x12348765)
+    la $a0, msg+1
+    la $a1, later+4
+    beq $t0, $t1, start+8
+    j end
+    sll $t0, $t0, 1+1
+    sw $t0, 4*2($sp)
+    sw $t0, (4*2)($sp)
+    nop
+end:
+    nop
+.data
+later: .word 0
+.word end - start
+.word end-start+later-later
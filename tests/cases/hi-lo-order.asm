@@ -0,0 +1,13 @@
+; check: relocatable
+; the linker pairs each HI16 with the LO16 after it, so a %hi written after
+; its %lo is listed before it, and a LO16 with another addend is not its pair
+.text
+    ori $t0, $t0, %lo(ext)
+    lui $t0, %hi(ext)
+    lui $t1, %hi(ext+4)
+    addiu $t2, $t2, %lo(ext+8)
+    addiu $t1, $t1, %lo(ext+4)
+    lui $t3, %hi(local)
+    .data
+    .word 0
+local: .word 1
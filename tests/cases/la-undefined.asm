@@ -0,0 +1,8 @@
+; an undefined symbol is reported once for each line that uses it, though
+; la refers to it twice
+.text
+main:
+    la $a0, ext
+    la $a1, ext+4
+    lui $t0, %hi(ext)
+    j ext
@@ -0,0 +1,15 @@
+; macro arguments, strings included, replace the parameters of the body
+.equ count, 3
+.macro say s, n
+    .asciiz \s
+    .align 2
+    li $t0, \n
+.endm
+.macro twice a, b
+    say \a, count
+    say \b, (1<<4)|count
+.endm
+.text
+main:
+    twice "one", "two"
+    say "three", -1
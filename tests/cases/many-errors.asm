@@ -0,0 +1,101 @@
+; the first errors are kept, those past the limit are only counted
+    li $t0, 1 +
+    li $t0, 2 +
+    li $t0, 3 +
+    li $t0, 4 +
+    li $t0, 5 +
+    li $t0, 6 +
+    li $t0, 7 +
+    li $t0, 8 +
+    li $t0, 9 +
+    li $t0, 10 +
+    li $t0, 11 +
+    li $t0, 12 +
+    li $t0, 13 +
+    li $t0, 14 +
+    li $t0, 15 +
+    li $t0, 16 +
+    li $t0, 17 +
+    li $t0, 18 +
+    li $t0, 19 +
+    li $t0, 20 +
+    li $t0, 21 +
+    li $t0, 22 +
+    li $t0, 23 +
+    li $t0, 24 +
+    li $t0, 25 +
+    li $t0, 26 +
+    li $t0, 27 +
+    li $t0, 28 +
+    li $t0, 29 +
+    li $t0, 30 +
+    li $t0, 31 +
+    li $t0, 32 +
+    li $t0, 33 +
+    li $t0, 34 +
+    li $t0, 35 +
+    li $t0, 36 +
+    li $t0, 37 +
+    li $t0, 38 +
+    li $t0, 39 +
+    li $t0, 40 +
+    li $t0, 41 +
+    li $t0, 42 +
+    li $t0, 43 +
+    li $t0, 44 +
+    li $t0, 45 +
+    li $t0, 46 +
+    li $t0, 47 +
+    li $t0, 48 +
+    li $t0, 49 +
+    li $t0, 50 +
+    li $t0, 51 +
+    li $t0, 52 +
+    li $t0, 53 +
+    li $t0, 54 +
+    li $t0, 55 +
+    li $t0, 56 +
+    li $t0, 57 +
+    li $t0, 58 +
+    li $t0, 59 +
+    li $t0, 60 +
+    li $t0, 61 +
+    li $t0, 62 +
+    li $t0, 63 +
+    li $t0, 64 +
+    li $t0, 65 +
+    li $t0, 66 +
+    li $t0, 67 +
+    li $t0, 68 +
+    li $t0, 69 +
+    li $t0, 70 +
+    li $t0, 71 +
+    li $t0, 72 +
+    li $t0, 73 +
+    li $t0, 74 +
+    li $t0, 75 +
+    li $t0, 76 +
+    li $t0, 77 +
+    li $t0, 78 +
+    li $t0, 79 +
+    li $t0, 80 +
+    li $t0, 81 +
+    li $t0, 82 +
+    li $t0, 83 +
+    li $t0, 84 +
+    li $t0, 85 +
+    li $t0, 86 +
+    li $t0, 87 +
+    li $t0, 88 +
+    li $t0, 89 +
+    li $t0, 90 +
+    li $t0, 91 +
+    li $t0, 92 +
+    li $t0, 93 +
+    li $t0, 94 +
+    li $t0, 95 +
+    li $t0, 96 +
+    li $t0, 97 +
+    li $t0, 98 +
+    li $t0, 99 +
+    li $t0, 100 +
@@ -0,0 +1,11 @@
+; check: optimize
+; the instruction before a branch moves into its delay slot unless the
+; branch depends on it
+.text
+main:
+    addiu $t0, $t0, 1
+    beq $t1, $t2, main
+    addiu $t1, $t1, 1
+    bne $t1, $t2, main
+    lw $t3, 0($sp)
+    j main
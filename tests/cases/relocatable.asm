@@ -0,0 +1,17 @@
+; check: relocatable
+.text
+.globl main
+main:
+    lui $t0, %hi(ext+12)
+    addiu $t0, $t0, %lo(ext+12)
+    lw $t1, %lo(local+4)($t0)
+    la $a0, local+8
+    jal ext+0
+    beq $t0, $t1, main+4
+    .data
+local: .word 1
+    .word ext-4
+    .word local+4
+
+main2: .word 0
+    .word local-main2
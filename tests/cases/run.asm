@@ -0,0 +1,30 @@
+; check: run optimize
+; prints through syscalls and exits with a status. The loop's add moves into
+; the delay slot of its branch, so it must run exactly once per iteration,
+; and the slot of jal runs before the call.
+.data
+label: .asciiz "sum "
+.text
+main:
+    li $t0, 0
+    li $t1, 5
+loop:
+    addiu $t1, $t1, -1
+    addu $t0, $t0, $t1
+    bne $t1, $zero, loop
+    la $a0, label
+    li $v0, 4
+    syscall
+    move $a0, $t0
+    jal print_line
+    li $a0, 3
+    li $v0, 17
+    syscall
+
+print_line:
+    li $v0, 1
+    syscall
+    li $a0, 10
+    li $v0, 11
+    syscall
+    jr $ra
@@ -0,0 +1,4 @@
+; a fill that ends exactly at 2^32 wraps the size to 0
+.data
+.byte 1
+.space 0xffffffff
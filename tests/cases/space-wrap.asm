@@ -0,0 +1,5 @@
+; the end of .space wraps past 2^32, it must be an error rather than a short fill
+.data
+.word 1
+.word 2
+.space 0xfffffffc
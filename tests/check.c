@@ -0,0 +1,614 @@
+// Regression tests, run by ctest.
+//
+// `asm-check DIR` assembles every DIR/*.asm through the embedding API and
+// compares a listing of the result with DIR/NAME.expected, or writes that
+// file with --update. A first line "; check: relocatable optimize big-endian"
+// sets options, and "run" adds what the program prints and its exit status
+// under the simulator. Every case is assembled on one context shared by all
+// of them, so after the errors of the cases before it, and on a fresh
+// context; the two must agree.
+//
+// `asm-check --parallel` assembles generated sources in order and split
+// across threads, and checks that the output and the errors are the same.
+//
+// `asm-check --cache DIR` stores the output of each case in an empty cache,
+// checks that loading it gives the same output, then truncates the entry and
+// checks that it is a miss.
+
+#include <mips-as/mips-as.h>
+#include <mips-as/prelude.h>
+
+#include <glib/gstdio.h>
+#include <string.h>
+
+#include "assembler.h"
+#include "cache.h"
+#include "elf.h"
+#include "sim.h"
+
+static gboolean update = FALSE;
+static gboolean parallel = FALSE;
+static gboolean cache = FALSE;
+static gchar** dirs = NULL;
+
+static GOptionEntry entries[] = {
+    { "update", 'u', 0, G_OPTION_ARG_NONE, &update, "Write the .expected files instead of comparing", NULL },
+    { "parallel", 'p', 0, G_OPTION_ARG_NONE, &parallel, "Compare parallel with sequential runs", NULL },
+    { "cache", 'c', 0, G_OPTION_ARG_NONE, &cache, "Store, load and truncate a cache entry of each case", NULL },
+    { G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &dirs, "Directories of cases", "DIR..." },
+    { NULL }
+};
+
+// Reports the first line where `actual` differs from `expected`
+static bool same(const char* what, const char* expected, const char* actual) {
+    if (strcmp(expected, actual) == 0) {
+        return true;
+    }
+    size_t i = 0, start = 0;
+    uint32_t line = 1;
+    while (expected[i] == actual[i]) {
+        if (expected[i++] == '\n') {
+            start = i;
+            line++;
+        }
+    }
+    const char* e = expected + start;
+    const char* a = actual + start;
+    printf("%s: differs at line %u\n  expected: %.*s\n  actual:   %.*s\n", what, line, (int) strcspn(e, "\n"), e,
+           (int) strcspn(a, "\n"), a);
+    return false;
+}
+
+// Cases
+
+static const char* section_names[] = { "text", "data", "absolute" };
+static const char* reloc_names[] = { "HI16", "LO16", "PC16", "J26", "WORD32" };
+
+static void list_section(GString* out, const char* name, const mips_as_section_t* section, bool big_endian) {
+    g_string_append_printf(out, "%s 0x%08x align %u, %u bytes\n", name, section->address, section->align,
+                           section->size);
+    uint32_t i = 0;
+    for (; i + 4 <= section->size; i += 4) {
+        const uint8_t* b = section->data + i;
+        uint32_t word = big_endian ? (uint32_t) b[0] << 24 | (uint32_t) b[1] << 16 | (uint32_t) b[2] << 8 | b[3]
+                                   : (uint32_t) b[3] << 24 | (uint32_t) b[2] << 16 | (uint32_t) b[1] << 8 | b[0];
+        g_string_append_printf(out, "  %08x: %08x\n", section->address + i, word);
+    }
+    if (i < section->size) {
+        g_string_append_printf(out, "  %08x:", section->address + i);
+        for (; i < section->size; i++) {
+            g_string_append_printf(out, " %02x", section->data[i]);
+        }
+        g_string_append_c(out, '\n');
+    }
+}
+
+static void list_result(GString* out, bool ok, const mips_as_result_t* result, bool big_endian) {
+    g_string_append(out, ok ? "ok\n" : "failed\n");
+    if (ok) {
+        list_section(out, "text", &result->text, big_endian);
+        list_section(out, "data", &result->data, big_endian);
+        g_string_append_printf(out, "delay slots %u, filled %u\n", result->delay_slots, result->delay_filled);
+    }
+    for (uint32_t i = 0; i < result->nsymbols; i++) {
+        const mips_as_symbol_t* sym = &result->symbols[i];
+        g_string_append_printf(out, "symbol %s %s 0x%08x%s%s\n", sym->name, section_names[sym->section], sym->address,
+                               sym->defined ? " defined" : "", sym->global ? " global" : "");
+    }
+    for (uint32_t i = 0; i < result->nrelocations; i++) {
+        const mips_as_relocation_t* rel = &result->relocations[i];
+        g_string_append_printf(out, "relocation %s %s+0x%x %s (line %u)\n", reloc_names[rel->kind],
+                               section_names[rel->section], rel->offset,
+                               rel->symbol != NULL ? rel->symbol : section_names[rel->target], rel->line);
+    }
+    for (uint32_t i = 0; i < result->ndiagnostics; i++) {
+        const mips_as_diagnostic_t* diagnostic = &result->diagnostics[i];
+        g_string_append_printf(out, "error %u:%u %.*s\n", diagnostic->line, diagnostic->column,
+                               (int) strcspn(diagnostic->message, "\n"), diagnostic->message);
+    }
+    if (result->ndropped > 0) {
+        g_string_append_printf(out, "%u more errors\n", result->ndropped);
+    }
+}
+
+static void read_options(const char* src, mips_as_options_t* options, bool* run_program) {
+    static const char prefix[] = "; check:";
+    memset(options, 0, sizeof(*options));
+    *run_program = false;
+    if (strncmp(src, prefix, sizeof(prefix) - 1) != 0) {
+        return;
+    }
+    gchar* line = g_strndup(src + sizeof(prefix) - 1, strcspn(src, "\n") - (sizeof(prefix) - 1));
+    gchar** words = g_strsplit(g_strstrip(line), " ", -1);
+    for (gchar** word = words; *word != NULL; word++) {
+        if (strcmp(*word, "relocatable") == 0) {
+            options->relocatable = true;
+        } else if (strcmp(*word, "optimize") == 0) {
+            options->optimize = true;
+        } else if (strcmp(*word, "big-endian") == 0) {
+            options->big_endian = true;
+        } else if (strcmp(*word, "run") == 0) {
+            *run_program = true;
+        } else if (**word != '\0') {
+            FATAL("Unknown check option: %s\n", *word)
+        }
+    }
+    g_strfreev(words);
+    g_free(line);
+    if (*run_program && options->relocatable) {
+        FATAL("A relocatable case cannot be run\n")
+    }
+}
+
+static GString* assemble(mips_as_context_t* ctx, const char* src, size_t len, const mips_as_options_t* options) {
+    mips_as_result_t result;
+    bool ok = mips_as_assemble(ctx, src, len, options, &result);
+    GString* out = g_string_new(NULL);
+    list_result(out, ok, &result, options->big_endian);
+    return out;
+}
+
+// Far more than any case needs, a program that loops stops with a listing
+// that says so
+#define RUN_STEPS 100000
+
+// Lists what the program of a case prints, one "| " line per line, and how it
+// ended
+static void list_run(GString* out, const char* src, size_t len, const mips_as_options_t* options) {
+    diagnostics_t* diags = g_new(diagnostics_t, 1);
+    diag_init(diags);
+    assembler_t as = assembler_new(src, len);
+    assembler_set_optimize(&as, options->optimize);
+    assembler_set_big_endian(&as, options->big_endian);
+    assembler_set_diagnostics(&as, diags);
+    assembler_run(&as);
+    if (diags->count == 0) {
+        sim_t sim;
+        sim_init(&sim, &as);
+        sim_status_t status = sim_run(&sim, RUN_STEPS);
+        gchar** lines = g_strsplit(sim.out->str, "\n", -1);
+        for (gchar** line = lines; *line != NULL; line++) {
+            // the text after the last newline, if any
+            if (line[1] != NULL || **line != '\0') {
+                g_string_append_printf(out, "| %s\n", *line);
+            }
+        }
+        g_strfreev(lines);
+        if (status == SIM_EXITED) {
+            g_string_append_printf(out, "exit %d\n", sim.exit_code);
+        } else if (status == SIM_FAULT) {
+            g_string_append_printf(out, "fault %s (pc 0x%08x)\n", sim.fault, sim.fault_pc);
+        } else {
+            g_string_append_printf(out, "stopped after %" G_GUINT64_FORMAT " instructions\n", sim.steps);
+        }
+        sim_free(&sim);
+    }
+    assembler_free(&as);
+    g_free(diags);
+}
+
+// Stands for a handler of the embedding program, which mips_as_assemble
+// must leave in place
+static void embedder_fatal(uint32_t line, uint32_t column, const char* message, gpointer data) {
+    (void) line;
+    (void) column;
+    (void) data;
+    g_printerr("%s", message);
+}
+
+static bool check_case(mips_as_context_t* shared, const char* path) {
+    gchar* src;
+    gsize len;
+    GError* err = NULL;
+    if (!g_file_get_contents(path, &src, &len, &err)) {
+        FATAL("%s\n", err->message)
+    }
+    mips_as_options_t options;
+    bool run_program;
+    read_options(src, &options, &run_program);
+
+    GString* actual = assemble(shared, src, len, &options);
+    mips_as_context_t* fresh = mips_as_context_new();
+    GString* alone = assemble(fresh, src, len, &options);
+    mips_as_context_free(fresh);
+
+    gchar* stem = g_strndup(path, strlen(path) - strlen(".asm"));
+    gchar* expected_path = g_strdup_printf("%s.expected", stem);
+    gchar* what = g_strdup_printf("%s on a reused context", path);
+    bool ok = same(what, alone->str, actual->str);
+    fatal_handler_t handler;
+    gpointer data;
+    fatal_get_handler(&handler, &data);
+    if (handler != embedder_fatal) {
+        printf("%s: the fatal handler was not restored\n", path);
+        ok = false;
+    }
+    if (run_program) {
+        list_run(actual, src, len, &options);
+    }
+    if (update) {
+        if (!g_file_set_contents(expected_path, actual->str, (gssize) actual->len, &err)) {
+            FATAL("%s\n", err->message)
+        }
+    } else {
+        gchar* expected;
+        if (!g_file_get_contents(expected_path, &expected, NULL, &err)) {
+            printf("%s: %s, run with --update\n", path, err->message);
+            g_clear_error(&err);
+            ok = false;
+        } else {
+            ok = same(path, expected, actual->str) && ok;
+            g_free(expected);
+        }
+    }
+
+    g_free(what);
+    g_free(expected_path);
+    g_free(stem);
+    g_string_free(alone, TRUE);
+    g_string_free(actual, TRUE);
+    g_free(src);
+    return ok;
+}
+
+static gint compare_paths(gconstpointer a, gconstpointer b) {
+    return strcmp(*(const char* const*) a, *(const char* const*) b);
+}
+
+// The .asm files of `dir_path`, sorted
+static GPtrArray* case_paths(const char* dir_path) {
+    GError* err = NULL;
+    GDir* dir = g_dir_open(dir_path, 0, &err);
+    if (dir == NULL) {
+        FATAL("%s\n", err->message)
+    }
+    GPtrArray* paths = g_ptr_array_new_with_free_func(g_free);
+    const gchar* name;
+    while ((name = g_dir_read_name(dir)) != NULL) {
+        if (g_str_has_suffix(name, ".asm")) {
+            g_ptr_array_add(paths, g_build_filename(dir_path, name, NULL));
+        }
+    }
+    g_dir_close(dir);
+    g_ptr_array_sort(paths, compare_paths);
+    return paths;
+}
+
+static uint32_t check_cases(const char* dir_path) {
+    GPtrArray* paths = case_paths(dir_path);
+    mips_as_context_t* ctx = mips_as_context_new();
+    fatal_set_handler(embedder_fatal, NULL);
+    uint32_t failed = 0;
+    for (guint i = 0; i < paths->len; i++) {
+        failed += !check_case(ctx, g_ptr_array_index(paths, i));
+    }
+    fatal_set_handler(NULL, NULL);
+    mips_as_context_free(ctx);
+    printf("%s: %u cases, %u failed\n", dir_path, paths->len, failed);
+    g_ptr_array_free(paths, TRUE);
+    return failed;
+}
+
+// Parallel runs
+
+typedef struct generator {
+    GString* out;
+    uint64_t state;
+    // labels L0 to L<defined - 1> are defined, references go up to L<referenced - 1>
+    uint32_t defined;
+    uint32_t referenced;
+    // lines that refer to undefined symbols, fewer than DIAG_CAPACITY
+    uint32_t errors;
+} generator_t;
+
+// xorshift64*, as in tools/bench.c
+static uint32_t next(generator_t* gen, uint32_t bound) {
+    gen->state ^= gen->state >> 12;
+    gen->state ^= gen->state << 25;
+    gen->state ^= gen->state >> 27;
+    return (uint32_t) ((gen->state * 0x2545F4914F6CDD1DULL) >> 32) % bound;
+}
+
+// A label defined a little before or after the reference
+static uint32_t any_label(generator_t* gen) {
+    uint32_t label = gen->defined + next(gen, 8);
+    label = label >= 4 ? label - 4 : label;
+    gen->referenced = MAX(gen->referenced, label + 1);
+    return label;
+}
+
+typedef enum variant {
+    VARIANT_RELOCATABLE = 1 << 0,
+    VARIANT_OPTIMIZE = 1 << 1,
+    // references to symbols that are never defined
+    VARIANT_ERRORS = 1 << 2,
+    // differences of labels, which make chunks fall back to running in order
+    VARIANT_DIFFERENCES = 1 << 3,
+} variant_t;
+
+static void gen_line(generator_t* gen, uint32_t variant) {
+    GString* out = gen->out;
+    switch (next(gen, 12)) {
+        case 0:
+            g_string_append_printf(out, "L%u:\n", gen->defined++);
+            break;
+        case 1: {
+            uint32_t label = any_label(gen), addend = 4 * next(gen, 4);
+            g_string_append_printf(out, "    lui $t0, %%hi(L%u+%u)\n    lw $t1, %%lo(L%u+%u)($t0)\n", label, addend,
+                                   label, addend);
+            break;
+        }
+        case 2:
+            g_string_append_printf(out, "    la $a0, L%u+%u\n", any_label(gen), 4 * next(gen, 4));
+            break;
+        case 3:
+            g_string_append_printf(out, "    %s L%u+4\n", next(gen, 2) ? "j" : "jal", any_label(gen));
+            break;
+        case 4:
+            if (gen->defined > 0) {
+                g_string_append_printf(out, "    beq $t0, $t1, L%u+4\n", gen->defined - 1 - next(gen, MIN(gen->defined, 4)));
+            }
+            break;
+        case 5:
+            g_string_append_printf(out, ".data\n    .word L%u-4\n    .half %u\n    .align 2\n.text\n", any_label(gen),
+                                   next(gen, 0x10000));
+            break;
+        case 6:
+            g_string_append_printf(out, "    addiu $t2, $t2, (%u<<2)|1\n    sw $t2, 4*%u($sp)\n", next(gen, 64),
+                                   next(gen, 8));
+            break;
+        case 7:
+            if ((variant & VARIANT_ERRORS) && gen->errors < 16 && next(gen, 64) == 0) {
+                g_string_append_printf(out, "    la $a1, missing%u+4\n", next(gen, 4));
+                gen->errors++;
+                break;
+            }
+            if ((variant & VARIANT_DIFFERENCES) && gen->defined > 1 && next(gen, 64) == 0) {
+                g_string_append_printf(out, "    li $t3, L%u-L0\n", gen->defined - 1);
+                break;
+            }
+            // fall through
+        default:
+            g_string_append_printf(out, "    addu $t%u, $t%u, $t%u\n", next(gen, 8), next(gen, 8), next(gen, 8));
+            break;
+    }
+}
+
+static GString* generate(size_t size, uint32_t variant) {
+    generator_t gen = { g_string_sized_new(size + 256), 0x9E3779B97F4A7C15ULL * (variant + 1), 0, 0, 0 };
+    g_string_append(gen.out, ".text\n.globl main\nmain:\n");
+    while (gen.out->len < size) {
+        gen_line(&gen, variant);
+    }
+    while (gen.defined < gen.referenced) {
+        g_string_append_printf(gen.out, "L%u:\n    nop\n", gen.defined++);
+    }
+    return gen.out;
+}
+
+static gint compare_atoms(gconstpointer a, gconstpointer b) {
+    return strcmp(atom_str(*(const atom_t*) a), atom_str(*(const atom_t*) b));
+}
+
+static void list_buffer(GString* out, const char* name, const buffer_t* buff) {
+    g_string_append_printf(out, "%s 0x%08x align %u, %u bytes\n", name, buff->base, buff->align, buff->size);
+    for (uint32_t i = 0; i + 4 <= buff->size; i += 4) {
+        uint32_t word;
+        memcpy(&word, buff->data + i, sizeof(word));
+        g_string_append_printf(out, "%08x\n", word);
+    }
+}
+
+// Everything the assembler produced, or its errors
+static GString* list_assembler(assembler_t* as, const diagnostics_t* diags) {
+    GString* out = g_string_new(NULL);
+    diag_print(out, "", diags);
+    if (diags->count == 0) {
+        list_buffer(out, "text", &as->textbuff);
+        list_buffer(out, "data", &as->databuff);
+        g_string_append_printf(out, "delay slots %u, filled %u\n", as->delay_slots, as->delay_filled);
+        GArray* names = g_array_new(FALSE, FALSE, sizeof(atom_t));
+        GHashTableIter iter;
+        gpointer value;
+        g_hash_table_iter_init(&iter, as->symbols.symbols);
+        while (g_hash_table_iter_next(&iter, NULL, &value)) {
+            g_array_append_val(names, ((const symbol_t*) value)->name);
+        }
+        g_array_sort(names, compare_atoms);
+        for (guint i = 0; i < names->len; i++) {
+            const symbol_t* sym = symtab_get(&as->symbols, g_array_index(names, atom_t, i));
+            g_string_append_printf(out, "symbol %s %u 0x%08x %d\n", atom_str(sym->name), sym->sector, sym->address,
+                                   sym->defined);
+        }
+        g_array_free(names, TRUE);
+        // chunks add theirs in another order
+        elf_sort_relocations(as);
+        for (guint i = 0; i < as->relocations->len; i++) {
+            const reference_t* rel = &g_array_index(as->relocations, reference_t, i);
+            g_string_append_printf(out, "relocation %d %u+0x%x %s 0x%x addend 0x%x (line %u)\n", rel->kind,
+                                   rel->sector, rel->offset, rel->symbol != ATOM_NONE ? atom_str(rel->symbol) : "-",
+                                   rel->value, rel->addend, rel->line);
+        }
+    }
+    return out;
+}
+
+static GString* run(const char* src, size_t len, uint32_t jobs, uint32_t variant) {
+    diagnostics_t* diags = g_new(diagnostics_t, 1);
+    diag_init(diags);
+    assembler_t as = assembler_new(src, len);
+    assembler_set_relocatable(&as, (variant & VARIANT_RELOCATABLE) != 0);
+    assembler_set_optimize(&as, (variant & VARIANT_OPTIMIZE) != 0);
+    assembler_set_diagnostics(&as, diags);
+    if (jobs > 1) {
+        assembler_run_parallel(&as, jobs);
+    } else {
+        assembler_run(&as);
+    }
+    GString* out = list_assembler(&as, diags);
+    assembler_free(&as);
+    g_free(diags);
+    return out;
+}
+
+static uint32_t check_parallel(void) {
+    static const uint32_t variants[] = {
+        0, VARIANT_RELOCATABLE, VARIANT_OPTIMIZE, VARIANT_RELOCATABLE | VARIANT_OPTIMIZE, VARIANT_ERRORS,
+        VARIANT_RELOCATABLE | VARIANT_ERRORS, VARIANT_DIFFERENCES, VARIANT_OPTIMIZE | VARIANT_DIFFERENCES,
+    };
+    uint32_t failed = 0;
+    for (uint32_t i = 0; i < G_N_ELEMENTS(variants); i++) {
+        // enough for several chunks
+        GString* src = generate(512 * 1024, variants[i]);
+        GString* expected = run(src->str, src->len, 1, variants[i]);
+        for (uint32_t jobs = 2; jobs <= 4; jobs += 2) {
+            GString* actual = run(src->str, src->len, jobs, variants[i]);
+            gchar* what = g_strdup_printf("variant %u with %u threads", variants[i], jobs);
+            failed += !same(what, expected->str, actual->str);
+            g_free(what);
+            g_string_free(actual, TRUE);
+        }
+        g_string_free(expected, TRUE);
+        g_string_free(src, TRUE);
+    }
+    printf("parallel: %u variants, %u failed\n", (uint32_t) G_N_ELEMENTS(variants), failed);
+    return failed;
+}
+
+// Cache
+
+// Assembles `src` with the options of its case, or loads it from the cache in
+// `dir`, and says which through `cached`
+static GString* run_cached(const char* src, size_t len, const mips_as_options_t* options, const char* dir,
+                           bool store, bool* cached) {
+    diagnostics_t* diags = g_new(diagnostics_t, 1);
+    diag_init(diags);
+    assembler_t as = assembler_new(src, len);
+    assembler_set_relocatable(&as, options->relocatable);
+    assembler_set_optimize(&as, options->optimize);
+    assembler_set_big_endian(&as, options->big_endian);
+    assembler_set_diagnostics(&as, diags);
+    *cached = cache_load(&as, dir);
+    if (!*cached) {
+        assembler_run(&as);
+        if (store && diags->count == 0) {
+            cache_store(&as, dir);
+        }
+    }
+    GString* out = list_assembler(&as, diags);
+    assembler_free(&as);
+    g_free(diags);
+    return out;
+}
+
+// The one entry in `dir`, NULL if the case was not stored
+static gchar* cache_entry(const char* dir) {
+    GDir* entries = g_dir_open(dir, 0, NULL);
+    const gchar* name = entries != NULL ? g_dir_read_name(entries) : NULL;
+    gchar* path = name != NULL ? g_build_filename(dir, name, NULL) : NULL;
+    if (entries != NULL) {
+        g_dir_close(entries);
+    }
+    return path;
+}
+
+// Returns false if the case failed, sets `stored` if it could be cached at all
+static bool check_cache_case(const char* path, bool* stored) {
+    gchar* src;
+    gsize len;
+    GError* err = NULL;
+    if (!g_file_get_contents(path, &src, &len, &err)) {
+        FATAL("%s\n", err->message)
+    }
+    mips_as_options_t options;
+    bool run_program;
+    read_options(src, &options, &run_program);
+    gchar* dir = g_dir_make_tmp("asm-check-XXXXXX", &err);
+    if (dir == NULL) {
+        FATAL("%s\n", err->message)
+    }
+
+    bool cached, ok = true;
+    GString* expected = run_cached(src, len, &options, dir, true, &cached);
+    gchar* entry = cache_entry(dir);
+    *stored = entry != NULL;
+    if (cached) {
+        printf("%s: loaded from an empty cache\n", path);
+        ok = false;
+    }
+    if (entry != NULL) {
+        GString* loaded = run_cached(src, len, &options, dir, false, &cached);
+        gchar* what = g_strdup_printf("%s loaded from the cache", path);
+        if (!cached) {
+            printf("%s: the entry stored was not loaded\n", path);
+            ok = false;
+        }
+        ok = same(what, expected->str, loaded->str) && ok;
+        g_free(what);
+        g_string_free(loaded, TRUE);
+
+        // every cut is a miss, after which the case is assembled as usual
+        gchar* contents;
+        gsize size;
+        if (!g_file_get_contents(entry, &contents, &size, &err)) {
+            FATAL("%s\n", err->message)
+        }
+        gsize cuts[] = { 0, 4, size / 2, size - 1 };
+        for (guint i = 0; i < G_N_ELEMENTS(cuts) && cuts[i] < size; i++) {
+            if (!g_file_set_contents(entry, contents, (gssize) cuts[i], &err)) {
+                FATAL("%s\n", err->message)
+            }
+            GString* truncated = run_cached(src, len, &options, dir, false, &cached);
+            what = g_strdup_printf("%s with the entry cut to %" G_GSIZE_FORMAT " bytes", path, cuts[i]);
+            if (cached) {
+                printf("%s: loaded\n", what);
+                ok = false;
+            }
+            ok = same(what, expected->str, truncated->str) && ok;
+            g_free(what);
+            g_string_free(truncated, TRUE);
+        }
+        g_free(contents);
+        g_remove(entry);
+        g_free(entry);
+    }
+
+    g_rmdir(dir);
+    g_free(dir);
+    g_string_free(expected, TRUE);
+    g_free(src);
+    return ok;
+}
+
+static uint32_t check_cache(const char* dir_path) {
+    GPtrArray* paths = case_paths(dir_path);
+    uint32_t failed = 0, stored = 0;
+    for (guint i = 0; i < paths->len; i++) {
+        bool entry;
+        failed += !check_cache_case(g_ptr_array_index(paths, i), &entry);
+        stored += entry;
+    }
+    printf("%s: %u cases cached, %u failed\n", dir_path, stored, failed);
+    g_ptr_array_free(paths, TRUE);
+    return failed;
+}
+
+int main(int argc, char** argv) {
+    GError* err = NULL;
+    GOptionContext* context = g_option_context_new("- run the regression tests");
+    g_option_context_add_main_entries(context, entries, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &err)) {
+        FATAL("%s\n", err->message)
+    }
+    g_option_context_free(context);
+
+    uint32_t failed = 0;
+    if (parallel) {
+        failed += check_parallel();
+    }
+    for (gchar** dir = dirs; dir != NULL && *dir != NULL; dir++) {
+        failed += cache ? check_cache(*dir) : check_cases(*dir);
+    }
+    g_strfreev(dirs);
+    return failed > 0;
+}
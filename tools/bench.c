@@ -0,0 +1,308 @@
+// Throughput benchmark for the tokenizer, the parser and the assembler.
+//
+// Generates a synthetic source of the requested size and mix (or reads the
+// given files) and reports MB/s and statements/s for each phase, plus the
+// peak resident set size.
+
+#include <mips-as/prelude.h>
+
+#include <string.h>
+#include <sys/resource.h>
+
+#include "assembler.h"
+#include "parse/parser.h"
+
+static gint size_mb = 16;
+static gint iterations = 3;
+static gint jobs = 1;
+static gint seed = 1;
+static gint labels = 10;
+static gint directives = 5;
+static gint strings = 2;
+static gint comments = 10;
+static gchar* emit = NULL;
+static gchar** files = NULL;
+
+static GOptionEntry entries[] = {
+    { "size", 's', 0, G_OPTION_ARG_INT, &size_mb, "Size of the generated source in MiB (16)", "MB" },
+    { "iterations", 'n', 0, G_OPTION_ARG_INT, &iterations, "Runs per phase, the fastest is reported (3)", "N" },
+    { "jobs", 'j', 0, G_OPTION_ARG_INT, &jobs, "Also time a parallel run with N threads", "N" },
+    { "seed", 0, 0, G_OPTION_ARG_INT, &seed, "Generator seed (1)", "N" },
+    { "labels", 0, 0, G_OPTION_ARG_INT, &labels, "Percentage of label lines (10)", "PCT" },
+    { "directives", 0, 0, G_OPTION_ARG_INT, &directives, "Percentage of data directive blocks (5)", "PCT" },
+    { "strings", 0, 0, G_OPTION_ARG_INT, &strings, "Percentage of long string literals (2)", "PCT" },
+    { "comments", 0, 0, G_OPTION_ARG_INT, &comments, "Percentage of comment lines (10)", "PCT" },
+    { "emit", 'e', 0, G_OPTION_ARG_FILENAME, &emit, "Write the generated source to FILE and exit", "FILE" },
+    { G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &files, "Benchmark these files instead", "FILE..." },
+    { NULL }
+};
+
+// Generator
+
+typedef struct generator {
+    GString* out;
+    uint64_t state;
+    uint32_t defined;
+} generator_t;
+
+// xorshift64*, the output must not depend on the platform's rand()
+static uint32_t next(generator_t* gen, uint32_t bound) {
+    gen->state ^= gen->state >> 12;
+    gen->state ^= gen->state << 25;
+    gen->state ^= gen->state >> 27;
+    return (uint32_t) ((gen->state * 0x2545F4914F6CDD1DULL) >> 32) % bound;
+}
+
+static const char* registers[] = {
+    "$zero", "$at", "$v0", "$v1", "$a0", "$a1", "$a2", "$a3", "$t0", "$t1", "$t2", "$t3", "$t4", "$t5", "$t6", "$t7",
+    "$s0", "$s1", "$s2", "$s3", "$s4", "$s5", "$s6", "$s7", "$t8", "$t9", "$k0", "$k1", "$gp", "$sp", "$fp", "$ra",
+};
+
+static inline const char* reg(generator_t* gen) {
+    return registers[next(gen, 32)];
+}
+
+static void gen_instruction(generator_t* gen) {
+    static const char* rtype[] = { "add", "addu", "sub", "subu", "and", "or", "xor", "nor", "slt", "sltu" };
+    static const char* itype[] = { "addi", "addiu", "slti", "andi", "ori", "xori" };
+    static const char* memory[] = { "lw", "sw", "lb", "lbu", "sh", "lh" };
+    GString* out = gen->out;
+
+    // everything referring to a label needs one defined before it, which
+    // also keeps branches in range
+    uint32_t kind = next(gen, gen->defined > 0 ? 10 : 5);
+    switch (kind) {
+        case 0:
+        case 1:
+            g_string_append_printf(out, "    %s %s, %s, %s", rtype[next(gen, 10)], reg(gen), reg(gen), reg(gen));
+            break;
+        case 2:
+            g_string_append_printf(out, "    %s %s, %s, %u", itype[next(gen, 6)], reg(gen), reg(gen), next(gen, 32768));
+            break;
+        case 3:
+            g_string_append_printf(out, "    %s %s, %u(%s)", memory[next(gen, 6)], reg(gen), 4 * next(gen, 64), reg(gen));
+            break;
+        case 4:
+            g_string_append_printf(out, "    sll %s, %s, %u", reg(gen), reg(gen), next(gen, 32));
+            break;
+        case 5:
+        case 6: {
+            uint32_t back = next(gen, MIN(gen->defined, 8));
+            g_string_append_printf(out, "    %s %s, %s, L%u", next(gen, 2) ? "beq" : "bne", reg(gen), reg(gen),
+                                   gen->defined - 1 - back);
+            break;
+        }
+        case 7:
+            g_string_append_printf(out, "    %s L%u", next(gen, 2) ? "j" : "jal", next(gen, gen->defined));
+            break;
+        case 8:
+            g_string_append_printf(out, "    la %s, L%u", reg(gen), next(gen, gen->defined));
+            break;
+        default:
+            g_string_append_printf(out, "    li %s, 0x%x", reg(gen), next(gen, 0x7fffffff));
+            break;
+    }
+    if (next(gen, 4) == 0) {
+        g_string_append(out, "    ; trailing comment");
+    }
+    g_string_append_c(out, '\n');
+}
+
+static void gen_directives(generator_t* gen) {
+    GString* out = gen->out;
+    g_string_append(out, ".data\n");
+    for (uint32_t i = next(gen, 8) + 1; i > 0; i--) {
+        switch (next(gen, 5)) {
+            case 0:
+                g_string_append_printf(out, "    .word %u\n", next(gen, 0x7fffffff));
+                break;
+            case 1:
+                g_string_append_printf(out, "    .half %u\n", next(gen, 0x10000));
+                break;
+            case 2:
+                g_string_append_printf(out, "    .byte %u\n", next(gen, 0x100));
+                break;
+            case 3:
+                g_string_append_printf(out, "    .space %u\n", next(gen, 64));
+                break;
+            default:
+                g_string_append_printf(out, "    .align %u\n", next(gen, 4));
+                break;
+        }
+    }
+    g_string_append(out, ".text\n");
+}
+
+static void gen_string(generator_t* gen) {
+    GString* out = gen->out;
+    g_string_append(out, ".data\n    .asciiz \"");
+    for (uint32_t i = next(gen, 160) + 40; i > 0; i--) {
+        if (next(gen, 32) == 0) {
+            g_string_append(out, "\\n");
+        } else {
+            g_string_append_c(out, (char) ('a' + next(gen, 26)));
+        }
+    }
+    g_string_append(out, "\"\n.text\n");
+}
+
+static void gen_comment(generator_t* gen) {
+    GString* out = gen->out;
+    g_string_append(out, "; ");
+    for (uint32_t i = next(gen, 60) + 10; i > 0; i--) {
+        g_string_append_c(out, next(gen, 6) == 0 ? ' ' : (char) ('a' + next(gen, 26)));
+    }
+    g_string_append_c(out, '\n');
+}
+
+static GString* generate(size_t size) {
+    generator_t gen = { g_string_sized_new(size + 256), (uint64_t) seed * 0x9E3779B97F4A7C15ULL + 1, 0 };
+    g_string_append(gen.out, ".text\n.globl main\nmain:\n");
+    while (gen.out->len < size) {
+        uint32_t r = next(&gen, 100);
+        if (r < (uint32_t) labels) {
+            g_string_append_printf(gen.out, "L%u:\n", gen.defined++);
+        } else if ((r -= labels) < (uint32_t) directives) {
+            gen_directives(&gen);
+        } else if ((r -= directives) < (uint32_t) strings) {
+            gen_string(&gen);
+        } else if ((r -= strings) < (uint32_t) comments) {
+            gen_comment(&gen);
+        } else {
+            gen_instruction(&gen);
+        }
+    }
+    return gen.out;
+}
+
+// Phases
+
+static uint64_t run_tokenize(const char* src, uint32_t len) {
+    arena_t arena;
+    arena_init(&arena);
+    tokenizer_t tk;
+    tokenizer_init(&tk, src, len, &arena);
+    token_t token;
+    uint64_t count = 0;
+    do {
+        tk_next(&tk, &token);
+        count++;
+        if (token.type == TK_NEWLINE) {
+            arena_reset(&arena);
+        }
+    } while (token.type != TK_EOF);
+    arena_free(&arena);
+    return count;
+}
+
+static uint64_t run_parse(const char* src, uint32_t len) {
+    parser_t parser;
+    parser_init(&parser, src, len);
+    ir_block_t block;
+    ir_init(&block);
+    uint64_t count = 0;
+    while (parser_fill(&parser, &block)) {
+        count += block.count;
+    }
+    ir_free(&block);
+    parser_free(&parser);
+    return count;
+}
+
+static uint64_t run_assemble(const char* src, uint32_t len, uint32_t threads) {
+    assembler_t as = assembler_new(src, len);
+    assembler_run_parallel(&as, threads);
+    uint64_t size = as.textbuff.size + as.databuff.size;
+    assembler_free(&as);
+    return size;
+}
+
+// Fastest of `iterations` runs, in seconds
+#define TIME(result, expr) {                                    \
+    (result) = G_MAXDOUBLE;                                     \
+    for (gint i_ = 0; i_ < iterations; i_++) {                  \
+        gint64 start_ = g_get_monotonic_time();                 \
+        expr;                                                   \
+        double s_ = (g_get_monotonic_time() - start_) / 1e6;    \
+        (result) = MIN((result), s_);                           \
+    }                                                           \
+}
+
+static void report(const char* phase, double seconds, size_t bytes, uint64_t statements) {
+    printf("%-12s %10.2f ms %10.1f MB/s %10.2f Mstmt/s\n", phase, seconds * 1e3, bytes / seconds / 1e6,
+           statements / seconds / 1e6);
+}
+
+static void bench(const char* name, const char* src, size_t len) {
+    if (len > UINT32_MAX) {
+        FATAL("%s: too large\n", name)
+    }
+    uint64_t statements = run_parse(src, (uint32_t) len);
+    printf("%s: %.1f MB, %" G_GUINT64_FORMAT " statements\n", name, len / 1e6, statements);
+
+    double seconds;
+    uint64_t sink = 0;
+    TIME(seconds, sink += run_tokenize(src, (uint32_t) len))
+    report("tokenize", seconds, len, statements);
+    TIME(seconds, sink += run_parse(src, (uint32_t) len))
+    report("parse", seconds, len, statements);
+    TIME(seconds, sink += run_assemble(src, (uint32_t) len, 1))
+    report("assemble", seconds, len, statements);
+    if (jobs > 1) {
+        char label[32];
+        g_snprintf(label, sizeof(label), "assemble -j%d", jobs);
+        TIME(seconds, sink += run_assemble(src, (uint32_t) len, (uint32_t) jobs))
+        report(label, seconds, len, statements);
+    }
+    // keeps the compiler from dropping the runs
+    if (sink == 0) {
+        printf("\n");
+    }
+}
+
+int main(int argc, char** argv) {
+    GError* err = NULL;
+    GOptionContext* context = g_option_context_new("[FILE...] - benchmark the assembler");
+    g_option_context_add_main_entries(context, entries, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &err)) {
+        g_printerr("%s\n", err->message);
+        g_error_free(err);
+        g_option_context_free(context);
+        return 1;
+    }
+    g_option_context_free(context);
+    iterations = MAX(iterations, 1);
+
+    if (files == NULL) {
+        GString* src = generate((size_t) MAX(size_mb, 1) << 20);
+        if (emit != NULL) {
+            if (!g_file_set_contents(emit, src->str, (gssize) src->len, &err)) {
+                FATAL("%s\n", err->message)
+            }
+        } else {
+            bench("generated", src->str, src->len);
+        }
+        g_string_free(src, TRUE);
+    } else {
+        for (gchar** file = files; *file != NULL; file++) {
+            GMappedFile* mapped = g_mapped_file_new(*file, FALSE, &err);
+            if (mapped == NULL) {
+                FATAL("%s\n", err->message)
+            }
+            bench(*file, g_mapped_file_get_contents(mapped), g_mapped_file_get_length(mapped));
+            g_mapped_file_unref(mapped);
+        }
+    }
+
+    if (emit == NULL) {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        // ru_maxrss is in KiB on Linux
+        printf("peak RSS     %10.1f MB\n", usage.ru_maxrss / 1024.0);
+    }
+
+    g_strfreev(files);
+    g_free(emit);
+    intern_free();
+    return 0;
+}
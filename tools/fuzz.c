@@ -0,0 +1,253 @@
+// Fuzz target for the tokenizer and the parser.
+//
+// Built with -DMIPS_AS_FUZZ=ON this is a libFuzzer binary. Otherwise it is a
+// driver that replays a corpus of files (or directories of them) through the
+// same entry point and reports the throughput, as a regression benchmark.
+//
+// Besides surviving any input, every run checks the vectorized scan kernels
+// and the number parser against plain reference implementations.
+
+#include <mips-as/prelude.h>
+
+#include <setjmp.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "parse/parser.h"
+#include "parse/scan.h"
+
+static jmp_buf recover;
+
+static void fuzz_fatal(uint32_t line, uint32_t column, const char* message, gpointer data) {
+    (void) line;
+    (void) column;
+    (void) message;
+    (void) data;
+    longjmp(recover, 1);
+}
+
+// Reference implementations
+
+static uint32_t ref_ident(const char* src, uint32_t pos, uint32_t len) {
+    while (pos < len && (g_ascii_isalnum(src[pos]) || src[pos] == '_')) {
+        pos++;
+    }
+    return pos;
+}
+
+// g_ascii_isspace() without '\n' and with '\v', like the tokenizer
+static uint32_t ref_spaces(const char* src, uint32_t pos, uint32_t len) {
+    while (pos < len && src[pos] != '\0' && strchr(" \t\r\v\f", src[pos]) != NULL) {
+        pos++;
+    }
+    return pos;
+}
+
+static uint32_t ref_line_end(const char* src, uint32_t pos, uint32_t len) {
+    while (pos < len && src[pos] != '\n') {
+        pos++;
+    }
+    return pos;
+}
+
+// Value of a number token, as the tokenizer is documented to read it
+static uint32_t ref_number(const char* text, uint32_t len) {
+    uint32_t i = 0, base = 10;
+    bool negative = text[0] == '-';
+    if (text[0] == '-' || text[0] == '+') {
+        i++;
+    }
+    if (i + 1 < len && text[i] == '0') {
+        char prefix = g_ascii_tolower(text[i + 1]);
+        if (prefix == 'x' || prefix == 'b') {
+            base = prefix == 'x' ? 16 : 2;
+            i += 2;
+        } else {
+            base = 8;
+        }
+    }
+    uint64_t value = 0;
+    for (; i < len; i++) {
+        value = value * base + (uint64_t) g_ascii_xdigit_value(text[i]);
+    }
+    return negative ? (uint32_t) -value : (uint32_t) value;
+}
+
+#define FUZZ_CHECK(expr, pos) {                                                 \
+    if (!(expr)) {                                                              \
+        fprintf(stderr, "fuzz: %s fails at offset %u\n", #expr, (pos));         \
+        abort();                                                                \
+    }                                                                           \
+}
+
+static void check_scans(const char* src, uint32_t len) {
+    for (uint32_t pos = 0; pos < len; pos++) {
+        FUZZ_CHECK(scan_ident(src, pos, len) == ref_ident(src, pos, len), pos)
+        FUZZ_CHECK(scan_spaces(src, pos, len) == ref_spaces(src, pos, len), pos)
+        FUZZ_CHECK(scan_line_end(src, pos, len) == ref_line_end(src, pos, len), pos)
+        if (pos + 8 <= len) {
+            uint64_t word;
+            memcpy(&word, src + pos, sizeof(word));
+            word = GUINT64_FROM_LE(word);
+            uint32_t count = 0;
+            while (count < 8 && g_ascii_isxdigit(src[pos + count])) {
+                count++;
+            }
+            FUZZ_CHECK(scan_hex_count8(word) == count, pos)
+            if (count == 8) {
+                uint32_t value = 0;
+                for (uint32_t i = 0; i < 8; i++) {
+                    value = value * 16 + (uint32_t) g_ascii_xdigit_value(src[pos + i]);
+                }
+                FUZZ_CHECK(scan_hex_value8(word) == value, pos)
+            }
+        }
+    }
+}
+
+static void check_numbers(const char* src, uint32_t len) {
+    static arena_t arena;
+    static tokenizer_t tk;
+    token_t token;
+
+    arena_init(&arena);
+    tokenizer_init(&tk, src, len, &arena);
+    if (setjmp(recover) == 0) {
+        do {
+            tk_next(&tk, &token);
+            if (token.type == TK_NUMBER) {
+                FUZZ_CHECK(token.num == ref_number(src + token.span.offset, token.span.length), token.span.offset)
+            }
+            arena_reset(&arena);
+        } while (token.type != TK_EOF);
+    }
+    arena_free(&arena);
+}
+
+// Entry points
+
+// Parses `src` to the end, recovering from syntax errors, and returns the
+// number of statements, or -1 if the source has an error
+static int64_t fuzz_parse(const char* src, uint32_t len) {
+    // static, longjmp leaves locals changed after setjmp indeterminate
+    static parser_t parser;
+    static ir_block_t block;
+    static diagnostics_t diags;
+    static int64_t count;
+
+    count = 0;
+    diag_init(&diags);
+    parser_init(&parser, src, len);
+    parser_set_diagnostics(&parser, &diags);
+    ir_init(&block);
+    if (setjmp(recover) == 0) {
+        while (parser_fill(&parser, &block)) {
+            count += block.count;
+        }
+        if (diags.count > 0) {
+            count = -1;
+        }
+    } else {
+        count = -1;
+    }
+    ir_free(&block);
+    parser_free(&parser);
+    return count;
+}
+
+int LLVMFuzzerInitialize(int* argc, char*** argv) {
+    (void) argc;
+    (void) argv;
+    fatal_set_handler(fuzz_fatal, NULL);
+    return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    if (size > UINT32_MAX) {
+        return 0;
+    }
+    // an exact size copy, a read past the end is caught by the sanitizers
+    char* src = g_malloc(MAX(size, 1));
+    memcpy(src, data, size);
+    uint32_t len = (uint32_t) size;
+
+    fuzz_parse(src, len);
+    check_scans(src, len);
+    check_numbers(src, len);
+
+    g_free(src);
+    return 0;
+}
+
+#ifdef FUZZ_STANDALONE
+
+static void collect(GPtrArray* paths, const char* path) {
+    if (!g_file_test(path, G_FILE_TEST_IS_DIR)) {
+        g_ptr_array_add(paths, g_strdup(path));
+        return;
+    }
+    GError* err = NULL;
+    GDir* dir = g_dir_open(path, 0, &err);
+    if (dir == NULL) {
+        FATAL("%s\n", err->message)
+    }
+    const gchar* name;
+    while ((name = g_dir_read_name(dir)) != NULL) {
+        g_ptr_array_add(paths, g_build_filename(path, name, NULL));
+    }
+    g_dir_close(dir);
+}
+
+static gint compare_paths(gconstpointer a, gconstpointer b) {
+    return strcmp(*(const char* const*) a, *(const char* const*) b);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        g_printerr("usage: %s FILE|DIR...\n", argv[0]);
+        return 1;
+    }
+
+    GPtrArray* paths = g_ptr_array_new_with_free_func(g_free);
+    for (int i = 1; i < argc; i++) {
+        collect(paths, argv[i]);
+    }
+    g_ptr_array_sort(paths, compare_paths);
+    LLVMFuzzerInitialize(&argc, &argv);
+
+    uint64_t bytes = 0, statements = 0, rejected = 0;
+    gint64 parsing = 0;
+    for (guint i = 0; i < paths->len; i++) {
+        const char* path = g_ptr_array_index(paths, i);
+        gchar* contents;
+        gsize len;
+        GError* err = NULL;
+        if (!g_file_get_contents(path, &contents, &len, &err) || len > UINT32_MAX) {
+            printf("%s: %s\n", path, err != NULL ? err->message : "too large");
+            g_clear_error(&err);
+            continue;
+        }
+
+        gint64 start = g_get_monotonic_time();
+        int64_t count = fuzz_parse(contents, (uint32_t) len);
+        parsing += g_get_monotonic_time() - start;
+        bytes += len;
+        statements += count > 0 ? (uint64_t) count : 0;
+        rejected += count < 0;
+
+        LLVMFuzzerTestOneInput((const uint8_t*) contents, len);
+        g_free(contents);
+    }
+
+    double seconds = MAX(parsing, 1) / 1e6;
+    printf("%u inputs, %" G_GUINT64_FORMAT " rejected, %.1f MB, %" G_GUINT64_FORMAT " statements\n", paths->len,
+           rejected, bytes / 1e6, statements);
+    printf("parse %10.2f ms %10.1f MB/s %10.2f Mstmt/s\n", seconds * 1e3, bytes / seconds / 1e6,
+           statements / seconds / 1e6);
+
+    g_ptr_array_free(paths, TRUE);
+    intern_free();
+    return 0;
+}
+
+#endif
@@ -0,0 +1,77 @@
+// Build-time generator for the opcode perfect hash.
+//
+// Finds a seed for opcode_hash() that maps every mnemonic in opcodes.def to a
+// distinct slot of a power-of-two table and writes the slot table as a header.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "../src/opcode_hash.h"
+
+static const char* mnemonics[] = {
+#define OP(name, format, layout, opcode, funct, flags) #name,
+#include "../src/opcodes.def"
+#undef OP
+};
+
+#define COUNT (sizeof(mnemonics) / sizeof(mnemonics[0]))
+#define MAX_BITS 12
+
+static bool try_seed(uint32_t seed, uint32_t bits, int16_t* slots) {
+    uint32_t size = 1u << bits;
+    for (uint32_t i = 0; i < size; i++) {
+        slots[i] = -1;
+    }
+    for (uint32_t i = 0; i < COUNT; i++) {
+        uint32_t slot = opcode_hash(mnemonics[i], strlen(mnemonics[i]), seed) & (size - 1);
+        if (slots[slot] >= 0) {
+            return false;
+        }
+        slots[slot] = (int16_t) i;
+    }
+    return true;
+}
+
+int main(int argc, const char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: opcodes-gen <output.h>\n");
+        return 1;
+    }
+
+    static int16_t slots[1u << MAX_BITS];
+
+    // Start at twice the table size and widen only if no seed is found quickly.
+    uint32_t bits = 1;
+    while ((1u << bits) < COUNT * 2) {
+        bits++;
+    }
+
+    for (; bits <= MAX_BITS; bits++) {
+        for (uint32_t seed = 0; seed < 1000000; seed++) {
+            if (!try_seed(seed, bits, slots)) {
+                continue;
+            }
+
+            FILE* out = fopen(argv[1], "w");
+            if (out == NULL) {
+                perror(argv[1]);
+                return 1;
+            }
+            fprintf(out, "// Generated by opcodes-gen from opcodes.def. Do not edit.\n");
+            fprintf(out, "#define OPCODE_HASH_SEED 0x%08xu\n", seed);
+            fprintf(out, "#define OPCODE_HASH_BITS %u\n\n", bits);
+            fprintf(out, "static const int16_t opcode_slots[%u] = {", 1u << bits);
+            for (uint32_t i = 0; i < (1u << bits); i++) {
+                fprintf(out, "%s%d,", i % 16 == 0 ? "\n    " : " ", slots[i]);
+            }
+            fprintf(out, "\n};\n");
+            fclose(out);
+            return 0;
+        }
+    }
+
+    fprintf(stderr, "opcodes-gen: no perfect hash seed found\n");
+    return 1;
+}